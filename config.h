@@ -9,9 +9,12 @@
 #define BORDER_WIDTH 2
 
 // Page settings (0 = vertical nav, 1 = horizontal nav)
+// MAX_PAGES and BUTTONS_PER_PAGE size the built-in tables below; a config
+// file may have any number of pages with up to 63 buttons each
 #define MAX_PAGES 2
 #define BUTTONS_PER_PAGE 5
 #define DEFAULT_PAGE 0
+#define PAGE_COLUMNS 1      // button columns on a page, unless the config file sets its own
 #define SCROLL_DIRECTION 1
 
 // Page indicator dots
@@ -20,15 +23,25 @@
 #define PAGE_DOT_SPACING 8
 
 // Animation and behavior
-#define MAX_ANIMATION_FRAMES 15
+#define ANIMATION_DURATION_MS 240
 #define IDLE_SLEEP_MS 50
-#define ANIMATION_SLEEP_MS 16
+#define ANIMATION_SLEEP_MS 16   // frame interval when the Present extension is unavailable
 #define HOVER_ZONE_WIDTH 10
 #define HOVER_ZONE_HEIGHT 100
+#define HOVER_POLL_FALLBACK 0   // 1 = poll the pointer every IDLE_SLEEP_MS instead of using an edge window
+#define FLASH_DAMAGE_MS 0       // >0 = debug: flash repainted regions for this long
+#define STARTUP_BUDGET_MS 50    // time-to-ready target checked by --startup-report
+#define PROBE_TTL_MS 5000       // probe results younger than this are reused instead of rerun
+#define PROBE_INTERVAL_MS 10000 // rerun probes this often while shown, 0 = only when the widget opens
+#define USE_ZYGOTE 1            // 1 = launch commands from a helper forked at startup, 0 = fork swgt itself
+#define TIMER_NOTIFY_COMMAND "notify-send Timer 'Timer finished.'"   // run once when a countdown ends, "" = none
+#define WORK_NOTIFY_COMMAND "notify-send Work 'Session over, time for a break.'"   // run when a work session reaches its length
+#define WORK_HISTORY_FILE "~/code/swgt/scripts/work_history"   // totals imported into a new work ledger, "" = none
 
 // Auto-calculated dimensions
-#define WIDGET_WIDTH (WIDGET_PADDING * 2 + BUTTON_SIZE)
-#define WIDGET_HEIGHT (WIDGET_PADDING * 2 + (BUTTONS_PER_PAGE * BUTTON_SIZE) + ((BUTTONS_PER_PAGE - 1) * BUTTON_MARGIN) + PAGE_INDICATOR_HEIGHT + 10)
+// The widget is as wide as its widest page and as tall as its tallest
+#define WIDGET_WIDTH_FOR(columns) (WIDGET_PADDING * 2 + ((columns) * BUTTON_SIZE) + (((columns) - 1) * BUTTON_MARGIN))
+#define WIDGET_HEIGHT_FOR(rows) (WIDGET_PADDING * 2 + ((rows) * BUTTON_SIZE) + (((rows) - 1) * BUTTON_MARGIN) + PAGE_INDICATOR_HEIGHT + 10)
 
 // Color theme (hex values)
 #define BG_COLOR               "#0d0f1c"
@@ -44,6 +57,9 @@
 #define ACTIVE_ICON_COLOR      "#c6a0f6"
 #define PAGE_COLOR             "#3a3d4a"
 #define PAGE_ACTIVE_COLOR      "#c6a0f6"
+#define RUNNING_BORDER_COLOR   "#8bd5ca"
+#define FAILED_BORDER_COLOR    "#ed8796"
+#define STALE_BORDER_COLOR     "#5b6078"
 
 // Font configuration
 #define ICON_FONT_NAME         "Symbols Nerd Font"
@@ -60,35 +76,49 @@
 #define WINDOW_OPACITY         1
 
 
-// { "icon", "name", "oncommand", "offcommand", toggle/click (0/1) }
+// { "icon", "name", "oncommand", "offcommand", toggle/click (0/1), "probe", "probe match", "live" }
+// A probe reports whether a toggle is on: its output contains the match,
+// or with an empty match it exits 0. Buttons sharing a probe run it once.
+// Instead of a command the probe can follow kernel events at no polling cost:
+//   "rfkill:TYPE"  on while every device of TYPE (wlan, bluetooth, all, ...) is blocked
+//   "file:PATH"    on while PATH exists and, if a match is given, contains it
+//   "link:IFACE"   on while the interface is in the match state: up (default), running, down
+// A live command keeps running and each line it prints replaces the name.
+// A "timer:SECONDS" on command starts a countdown on the button instead;
+// each click adds SECONDS, and TIMER_NOTIFY_COMMAND runs when it ends.
+// A "work:MINUTES" on command tracks work sessions of up to MINUTES (0 = no
+// limit) and shows today's total; "swgt stats" summarizes the history.
 
 // Page 0: System Controls
 #define PAGE_0_CONFIG { \
-    {"\uf0f3", "Dnd", "pkill -SIGUSR1 dunst", "pkill -SIGUSR2 dunst", 0}, \
-    {"\uf185", "Night", "redshift -O 3500", "redshift -x", 0}, \
-    {"\uf017", "Timer", "~/code/swgt/scripts/timer.sh", "", 1}, \
-    {"\uf0ae", "Work", "~/code/swgt/scripts/productivity.sh start", "~/code/swgt/scripts/productivity.sh stop", 0}, \
-    {"\uf011", "Power", "~/code/swgt/scripts/power.sh", "", 1} \
+    {"\uf0f3", "Dnd", "pkill -SIGUSR1 dunst", "pkill -SIGUSR2 dunst", 0, "dunstctl is-paused", "true", ""}, \
+    {"\uf185", "Night", "redshift -O 3500", "redshift -x", 0, "", "", ""}, \
+    {"\uf017", "Timer", "timer:60", "", 1, "", "", ""}, \
+    {"\uf0ae", "Work", "work:30", "", 0, "", "", ""}, \
+    {"\uf011", "Power", "~/code/swgt/scripts/power.sh", "", 1, "", "", ""} \
 }
 
 // Page 1: Connectivity & Devices
 #define PAGE_1_CONFIG { \
-    {"\uf1eb", "Wifi", "nmcli radio wifi off", "nmcli radio wifi on", 0}, \
-    {"\uf293", "Bt", "rfkill block bluetooth", "rfkill unblock bluetooth", 0}, \
-    {"\uf072", "Air", "rfkill block all; bluetoothctl power off", "rfkill unblock all; sleep 1; bluetoothctl power on", 0}, \
-    {"\uf108", "Mirror", "xrandr --output HDMI-1 --same-as eDP-1 --mode 1920x1080", "", 1}, \
-    {"\uf03d", "Rec", "n=1; while [ -e ~/Videos/screenrecord_${n}.mkv ]; do n=$((n+1)); done; ffmpeg -video_size 1920x1080 -framerate 30 -f x11grab -i :0.0 ~/Videos/screenrecord_${n}.mkv & echo $! > /tmp/screenrec_pid", "kill $(cat /tmp/screenrec_pid); rm /tmp/screenrec_pid", 0} \
+    {"\uf1eb", "Wifi", "nmcli radio wifi off", "nmcli radio wifi on", 0, "nmcli radio wifi", "disabled", ""}, \
+    {"\uf293", "Bt", "rfkill block bluetooth", "rfkill unblock bluetooth", 0, "rfkill:bluetooth", "", ""}, \
+    {"\uf072", "Air", "rfkill block all; bluetoothctl power off", "rfkill unblock all; sleep 1; bluetoothctl power on", 0, "rfkill:all", "", ""}, \
+    {"\uf108", "Mirror", "xrandr --output HDMI-1 --same-as eDP-1 --mode 1920x1080", "", 1, "", "", ""}, \
+    {"\uf03d", "Rec", "n=1; while [ -e ~/Videos/screenrecord_${n}.mkv ]; do n=$((n+1)); done; ffmpeg -video_size 1920x1080 -framerate 30 -f x11grab -i :0.0 ~/Videos/screenrecord_${n}.mkv & echo $! > /tmp/screenrec_pid; wait $!; rm -f /tmp/screenrec_pid", "kill $(cat /tmp/screenrec_pid); rm -f /tmp/screenrec_pid", 0, "file:/tmp/screenrec_pid", "", ""} \
 }
 
 
 // Button configuration helper
 static inline const void* get_page_config(int page) {
     static const struct {
-        char icon[8];
-        char text[32]; 
-        char toggle_command[256];
-        char untoggle_command[256];
+        const char *icon;
+        const char *text;
+        const char *toggle_command;
+        const char *untoggle_command;
         int click_only;
+        const char *probe_command;
+        const char *probe_match;
+        const char *live_command;
     } page_configs[][BUTTONS_PER_PAGE] = {
         PAGE_0_CONFIG,
         PAGE_1_CONFIG, 
@@ -1,220 +1,4004 @@
+#define _GNU_SOURCE
 #include <X11/Xlib.h>
+#include <X11/Xlibint.h>
 #include <X11/Xutil.h>
 #include <X11/Xatom.h>
 #include <X11/extensions/shape.h>
+#include <X11/extensions/presentproto.h>
 #include <X11/Xft/Xft.h>
+#include <X11/extensions/Xrender.h>
 #include <X11/keysym.h>
 #include <fontconfig/fontconfig.h>
+#ifdef USE_XCB
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stddef.h>
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <poll.h>
+#include <spawn.h>
+#include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/rfkill.h>
 #include <math.h>
 #include "config.h"
 
+#define LOOP_EVENT_BATCH 32
+#define PAGE_CACHE_SIZE 3   // current page plus both neighbours
+#define MAX_LABEL_GLYPHS 32
+#define MAX_STARTUP_PHASES 8
+#define PROBE_OUTPUT_SIZE 4096
+#define LIVE_LINE_SIZE 128
+#define COUNTDOWN_SIZE 16
+#define WORK_INDEX_MAGIC 0x58444957u   // "WIDX"
+#define WORK_INDEX_VERSION 2
+#define WORK_INDEX_SLACK 64            // days the index grows by at once
+#define MAX_RFKILL_DEVICES 16
+#define RFKILL_DEVICE "/dev/rfkill"     // SWGT_RFKILL_DEVICE overrides, e.g. with a FIFO
+#define NO_ENTRY UINT32_MAX
+#define MAX_PAGE_BUTTONS 63     // one damage bit each, the last bit belongs to the indicator
+#define MAX_PAGE_COLUMNS 8
+#define MAX_BUTTON_SPAN 4       // cells a button may cover in either direction
+#define MAX_PAGE_ROWS (MAX_PAGE_BUTTONS * MAX_BUTTON_SPAN)
+#define NO_HIT 0xff
+#define FILTER_PAGE -2          // page number the filter results are cached under
+#define MAX_QUERY_LENGTH 31
+#define CONTROL_SOCKET "swgt.sock"      // in $XDG_RUNTIME_DIR; SWGT_SOCKET overrides the whole path
+#define CONTROL_REPLY_SIZE 4096
+#define CONTROL_TIMEOUT_MS 2000         // a running instance that takes longer counts as hung
+#define CONTROL_NO_REPLY 3              // control_client result when the instance did not answer
+#define INDICATOR_DOTS ((WIDGET_WIDTH_FOR(1) - 2 * WIDGET_PADDING + PAGE_DOT_SPACING) / (PAGE_DOT_SIZE + PAGE_DOT_SPACING))
+
+// Anything here needs a real shell; plain words are exec'd directly
+#define SHELL_METACHARACTERS "|&;<>()$`\\\"'*?[]#{}!\n"
+
+// Primitives are submitted layer by layer; within a layer shapes never overlap,
+// so grouping them by colour does not change the result
+enum { LAYER_CLEAR, LAYER_FILL, LAYER_BORDER, LAYER_COUNT };
+
+enum { FONT_ICON, FONT_TEXT, FONT_PAGE, FONT_COUNT };
+
+// Colours in config order; all but the icon colours have an XColor in Widget
+enum {
+    COLOR_BG, COLOR_TEXT, COLOR_WINDOW_BORDER, COLOR_BORDER, COLOR_BUTTON_BG,
+    COLOR_ACTIVE_BG, COLOR_ACTIVE_TEXT, COLOR_ACTIVE_BORDER, COLOR_PRESSED_BG,
+    COLOR_PAGE, COLOR_PAGE_ACTIVE, COLOR_RUNNING_BORDER, COLOR_FAILED_BORDER,
+    COLOR_STALE_BORDER, COLOR_ICON, COLOR_ACTIVE_ICON, COLOR_COUNT
+};
+
+static const char *color_keys[COLOR_COUNT] = {
+    "bg", "text", "window_border", "border", "button_bg", "active_bg", "active_text",
+    "active_border", "pressed_bg", "page", "page_active", "running_border",
+    "failed_border", "stale_border", "icon", "active_icon"
+};
+static const char *font_keys[FONT_COUNT] = { "icon", "text", "page" };
+static const char *button_keys[] = { "icon", "text", "on", "off", "probe", "match", "live" };
+
+// Runtime configuration compiled to one relocatable block: header, page
+// index, button records in page order, then the string table they point
+// into. The same bytes are written to the cache and mapped back on later launches
+#define CONFIG_MAGIC 0x47464353u
+#define CONFIG_VERSION 4
+
+typedef struct {
+    uint32_t first_button, button_count;    // the page's run of button records
+    uint32_t slot_count;                    // last configured slot + 1
+    uint32_t columns, rows;                 // grid the slots were placed on
+} ConfigPage;
+
+typedef struct {
+    uint32_t page, slot;
+    uint32_t icon, text, toggle, untoggle, probe, match, live;   // string table offsets
+    uint32_t click_only;
+    uint8_t column, row, width, height;     // cells, placed when the config is compiled
+} ConfigButton;
+
+typedef struct {
+    uint32_t magic, version, size;
+    uint32_t page_count, button_count;
+    uint32_t max_columns, max_rows;         // grid of the widest and of the tallest page
+    uint32_t pages_offset, buttons_offset, strings_offset;
+    uint32_t colors[COLOR_COUNT];
+    uint32_t fonts[FONT_COUNT];
+    int32_t font_sizes[FONT_COUNT];
+    uint64_t defaults_hash;
+    uint64_t source_dev, source_ino, source_size;
+    int64_t source_mtime_ns;
+} ConfigImage;
+
+typedef struct {
+    ConfigPage *pages;
+    ConfigButton *buttons;
+    uint32_t page_count, page_capacity, button_count, button_capacity;
+    uint32_t colors[COLOR_COUNT];
+    uint32_t fonts[FONT_COUNT];
+    int32_t font_sizes[FONT_COUNT];
+    char *strings;
+    size_t strings_length, strings_capacity;
+    uint32_t *string_keys;      // open addressing on string offset + 1, 0 marks an empty bucket
+    uint32_t string_count, string_mask;
+} ConfigBuilder;
+
+// Fontconfig matching runs on a worker thread while the window is created
+typedef struct {
+    pthread_t thread;
+    Display *display;
+    int screen;
+    const char *names[FONT_COUNT];
+    int sizes[FONT_COUNT];
+    FcPattern *matches[FONT_COUNT];
+} FontMatchJob;
+
+typedef struct {
+    const char *name;
+    uint64_t end_us;
+} StartupPhase;
+
+// Label measured once at load: glyph indices plus the centred origin
+// relative to the box it is drawn in
+typedef struct {
+    FT_UInt glyphs[MAX_LABEL_GLYPHS];
+    short advances[MAX_LABEL_GLYPHS];
+    int count;
+    int x, y;
+} TextLayout;
+
+// One frame's drawing, grouped so each layer/colour or font/colour pair is one
+// array flushed with one call, however many buttons the page has
+typedef struct {
+    int layer;
+    XColor *color;
+    XRectangle *rects;
+    int count, capacity;
+} RectBatch;
+
 typedef struct {
-    char icon[8];
-    char text[32];
-    char toggle_command[256];
-    char untoggle_command[256];
-    int is_active;
-    int is_pressed;
-    int click_only;
+    XftFont *font;
+    XftColor *color;
+    XftGlyphSpec *specs;
+    int count, capacity;
+} GlyphBatch;
+
+// Batches and their arrays are kept between frames and grow with the busiest page drawn
+typedef struct {
+    RectBatch *rect_batches;
+    int rect_batch_count, rect_batch_capacity;
+    GlyphBatch *glyph_batches;
+    int glyph_batch_count, glyph_batch_capacity;
+} RenderList;
+
+// Button command prepared at load time, allocated in one block sized to fit.
+// Direct commands hold the resolved path followed by the argument words, each
+// NUL-terminated; the others hold the command line for sh -c and no argv
+typedef struct {
+    int direct;
+    size_t length;              // bytes used in buffer
+    char *buffer;
+    char **argv;
+} CompiledCommand;
+
+// What drawing and input touch on every frame; everything else lives in ButtonCommands
+typedef struct {
+    unsigned present : 1;       // slot has an icon; empty slots are skipped
+    unsigned is_active : 1;
+    unsigned is_pressed : 1;
+    unsigned click_only : 1;
+    unsigned failed : 1;
+    unsigned stale : 1;         // is_active has outlived PROBE_TTL_MS and a probe is running
+    unsigned target_active : 1; // state the command in flight establishes
+    unsigned cancelled : 1;     // command in flight was superseded and signalled
+    pid_t pid;                  // supervised command, 0 once the last child has been reaped
 } Button;
 
+// Cold side of a button. Its strings stay in the config's string table and
+// are found through entry; commands are compiled once to their exact size
+typedef struct {
+    uint32_t entry;             // index into the config's button records, NO_ENTRY for an empty slot
+    CompiledCommand *toggle, *untoggle;   // NULL when there is no command
+    uint64_t started_us;
+    int last_exit;              // -1 when killed by a signal
+    uint64_t last_runtime_us;
+    uint32_t spawn_seq;         // outstanding zygote request, pid is -1 until it answers
+    char *label;                // text set over the control socket, NULL for the configured one
+    int live;                   // label source, -1 for none
+    int timer_step;             // seconds a click adds for a "timer:SECONDS" command, 0 for none
+    uint64_t timer_deadline_us; // end of the running countdown, 0 for none
+    int work;                   // session length in minutes for a "work:MINUTES" command, 0 for
+                                // no limit, -1 for none
+    char countdown[COUNTDOWN_SIZE];   // remaining time as last laid out
+    int probe;                  // state probe shared with other buttons running the same command, -1 for none
+    int watch;                  // kernel event source used instead of a probe, -1 for none
+} ButtonCommands;
+
+// Buttons of one page, as many as its highest configured slot needs. They
+// are loaded on the page's first visit and keep their state from then on
+typedef struct {
+    int loaded;
+    Button *buttons;
+    ButtonCommands *commands;
+    XRectangle *rects;          // per slot, shared by drawing and hit testing; empty for gaps
+    uint8_t *hit_map;           // slot covering each grid cell, NO_HIT for none
+    int button_count;
+    int columns, rows;
+} Page;
+
+// Every 1-, 2- and 3-byte gram of the lowercased button labels, each with
+// the ascending records of the labels containing it. Built once per config,
+// when it is first searched
+typedef struct {
+    uint32_t *keys;             // open addressing, 0 marks an empty bucket
+    uint32_t *starts;           // postings of a bucket: starts[i] .. starts[i] + counts[i]
+    uint32_t *counts;
+    uint32_t *postings;         // button record indices
+    uint32_t mask;
+} SearchIndex;
+
+// Type-to-filter state. Each keystroke narrows the hits of the one before,
+// and every level is kept so backspace costs nothing
+typedef struct {
+    int active;
+    char query[MAX_QUERY_LENGTH + 1];
+    int length;
+    uint32_t *hits[MAX_QUERY_LENGTH + 1];
+    uint32_t hit_counts[MAX_QUERY_LENGTH + 1];
+    uint32_t *shown;            // hits in display order, as many as the results grid holds
+    int capacity;
+    Page view;                  // results grid; its slots lead to the real buttons
+} Filter;
+
+// Kernel-announced state bound to buttons through "rfkill:", "file:" or "link:"
+// in place of a probe command
+enum { WATCH_RFKILL, WATCH_FILE, WATCH_LINK, WATCH_TYPE_COUNT };
+
+typedef struct {
+    const char *spec;           // in the config's string table
+    int type;
+    char path[PATH_MAX];        // file path, or interface name for links
+    const char *name;           // file name within its watched directory
+    int wd;
+    int rfkill_type;
+    int blocked;
+    int exists;
+    char content[1024];
+    unsigned flags;
+} WatchSource;
+
+// Command whose output or exit status tells the real state of its buttons;
+// a result is done once both the pipe has closed and the child is reaped
+typedef struct {
+    const char *command;        // in the config's string table
+    CompiledCommand *compiled;
+    pid_t pid;
+    int fd;
+    int exited;
+    int status;
+    char output[PROBE_OUTPUT_SIZE];
+    size_t length;
+    uint64_t started_us;
+    uint64_t fresh_until_us;
+    
+    // Last complete result, kept for buttons on pages loaded after it arrived
+    int has_result;
+    int succeeded;
+    uint64_t result_started_us;
+} Probe;
+
+// Long-running command whose newest stdout line is the label of its buttons.
+// Lines are kept while hidden and laid out at most once per frame when shown
+typedef struct {
+    const char *command;        // in the config's string table, NULL for a free slot
+    CompiledCommand *compiled;
+    pid_t pid;
+    int fd;
+    char line[LIVE_LINE_SIZE];  // line being read
+    size_t length;
+    char text[LIVE_LINE_SIZE];  // last complete line
+    int has_text;
+    int dirty;                  // text not yet laid out on its buttons
+    int used;                   // still named by the config, during a reload
+} LiveLabel;
+
+// Button with a countdown running
+typedef struct {
+    int page, index;
+} TimerRef;
+
+// Worked time is kept as an append-only file of fixed records. A record is
+// written once a minute while a session runs and is never changed, so a
+// crash loses at most that minute
+typedef struct {
+    int32_t day;                // local days since the epoch
+    uint32_t seconds;           // worked time credited to that day
+    int64_t session;            // wall-clock start of the session it belongs to, 0 for imported history
+    uint64_t total;             // seconds in the ledger up to and including this record
+} WorkRecord;
+
+// Per-day totals of the ledger, mapped from the cache directory. It can
+// always be rebuilt from the ledger, and records appended since it was
+// last updated are added on the next lookup. Applying a record touches
+// three fields, and when the ledger is opened they are checked against
+// each other and against the ledger's running total, so an update cut
+// short by a crash is caught and the index rebuilt
+typedef struct {
+    uint32_t magic, version;
+    uint64_t records;           // ledger records already summed in
+    uint64_t total;             // their seconds, the ledger's total at records
+    int32_t first_day;          // day of totals[0]
+    uint32_t day_count;
+    uint32_t totals[];          // seconds per day
+} WorkIndex;
+
+typedef struct {
+    int fd, index_fd;           // -1 until a work button or "swgt stats" opens them
+    uint64_t ledger_total;      // total of the last record written
+    WorkIndex *index;
+    size_t index_size;
+    time_t session;             // start of the running session, 0 for none
+    uint64_t started_us, credited_us;
+    int limit_minutes;
+    char label[COUNTDOWN_SIZE]; // today's total, empty when there is no ledger
+} WorkLedger;
+
+// Launch request and its answers on the zygote socket; one datagram each
+typedef struct {
+    uint32_t seq;
+    uint32_t direct;
+    uint32_t length;
+    uint64_t sent_us;
+    char command[];             // CompiledCommand buffer, length bytes
+} ZygoteRequest;
+
+enum { ZYGOTE_SPAWNED, ZYGOTE_EXITED };
+
+typedef struct {
+    int type;
+    uint32_t seq;
+    pid_t pid;
+    int status;                 // posix_spawn error for SPAWNED, wait status for EXITED
+    uint64_t sent_us, spawned_us;
+} ZygoteReport;
+
+struct Widget;
+
+// File descriptor registered with the main loop
+typedef void (*LoopHandler)(struct Widget *widget, int fd, uint32_t events, void *data);
+
+// Events carry the slot and its generation rather than a pointer, so the
+// table can grow, and an event for a slot freed earlier in the same batch
+// is told apart from one for the source that took the slot over
+typedef struct {
+    int fd;
+    uint32_t generation;        // bumped each time the slot is freed
+    LoopHandler handler;
+    void *data;
+} LoopSource;
+
+// Regions of a page surface that are out of date
+typedef uint64_t DamageMask;
+#define DAMAGE_BUTTON(i) ((DamageMask)1 << (i))
+#define DAMAGE_INDICATOR ((DamageMask)1 << 63)
+#define DAMAGE_ALL (~(DamageMask)0)
+
+// Rendered page; damage marks what must be repainted before it is shown,
+// repainted what has changed since it was last copied to the window.
+// Labels are laid out when the surface takes a page, so only cached pages
+// hold any render state
 typedef struct {
+    Pixmap pixmap;
+    XftDraw *xft_draw;
+    int page;
+    DamageMask damage;
+    DamageMask repainted;
+    unsigned long last_used;
+    TextLayout *labels;         // icon then text layout of each button
+    int label_capacity;
+    TextLayout number;
+} PageSurface;
+
+typedef struct Widget {
     Display *display;
     Window window;
     Window root_window;
+    Window hover_window;
     GC gc;
-    XftDraw *xft_draw;
     XftFont *icon_font, *text_font, *page_font;
     XftColor xft_text_color, xft_active_text_color, xft_icon_color, xft_active_icon_color;
     XftColor xft_page_color, xft_page_active_color;
     Colormap colormap;
     Visual *visual;
     int has_compositor;
+    int colors_allocated;
+    
+    FontMatchJob font_job;
+    int fonts_loaded;
+    
+    ConfigImage *config;
+    size_t config_size;
+    int config_mapped;
+    char config_path[PATH_MAX];
+    const char *config_name;
+    int config_watch_fd;
+    int control_fd;             // listening control socket, -1 without one
+    
+    int startup_report;
+    int spawn_report;
+    int frame_report;
+    
+    Probe *probes;
+    int probe_count, probe_capacity;
+    int probe_timer_fd;
+    
+    LiveLabel *live_labels;
+    int live_count, live_capacity;
+    int live_timer_fd;
+    uint64_t live_flushed_us;
+    
+    int countdown_timer_fd;
+    CompiledCommand *timer_notify;  // TIMER_NOTIFY_COMMAND, NULL for none
+    TimerRef *timers;
+    int timer_count, timer_capacity;
+    
+    WorkLedger work;
+    int work_timer_fd;
+    CompiledCommand *work_notify;   // WORK_NOTIFY_COMMAND, NULL for none
+    
+    WatchSource *watches;
+    int watch_count, watch_capacity;
+    int rfkill_fd, inotify_fd, netlink_fd;
+    struct rfkill_event rfkill_devices[MAX_RFKILL_DEVICES];
+    int rfkill_device_count;
+    
+    pid_t zygote_pid;
+    int zygote_fd;
+    uint32_t spawn_seq;
+    uint64_t startup_begin_us;
+    StartupPhase startup_phases[MAX_STARTUP_PHASES];
+    int startup_phase_count;
+#ifdef USE_XCB
+    // Same connection as display; used for requests whose replies can be collected later
+    xcb_connection_t *xcb;
+    xcb_intern_atom_cookie_t cm_atom_cookie, opacity_atom_cookie;
+    xcb_get_selection_owner_cookie_t cm_owner_cookie;
+    xcb_query_pointer_cookie_t pointer_cookie;
+    int pointer_query_pending;
+#endif
     
     XColor bg_color, text_color, window_border_color, border_color, button_bg_color;
     XColor active_bg_color, active_text_color, active_border_color;
     XColor pressed_bg_color, page_color, page_active_color;
+    XColor running_border_color, failed_border_color, stale_border_color;
     
     int screen_width, screen_height;
     int current_x, target_x, hidden_x;
     int is_visible, is_closing, is_animating, mouse_in_zone;
+    int pinned;                 // shown over the control socket, stays until hidden
+    int has_focus, pointer_in_hover, pointer_in_widget;
     int needs_redraw;
-    int frame_count;
+    uint64_t animation_start_us;
+    int frame_pending;
+    
+    // Present extension vblank pacing; present_opcode is 0 when unavailable
+    int present_opcode;
+    XID present_eid;
+    uint32_t present_serial;
+    int present_notify_pending;
     
     int current_page;
     int total_pages;
-    Button buttons[MAX_PAGES][BUTTONS_PER_PAGE];
+    Page *pages;                // total_pages entries, empty until visited
+    int width, height;          // fit the widest and the tallest page
+    SearchIndex search;
+    Filter filter;
+    
+    RenderList render_list;
+    PageSurface page_cache[PAGE_CACHE_SIZE];
+    PageSurface *front_surface;
+    int front_page;
+    unsigned long cache_clock;
+    
+    int epoll_fd, timer_fd, signal_fd;
+    int timer_interval_ms;
+    int running;
+    LoopSource *loop_sources;
+    int loop_source_count, loop_source_capacity;
 } Widget;
 
 // Function declarations
 void init_widget(Widget *widget);
+uint64_t monotonic_us(void);
 void animate_widget(Widget *widget);
+void setup_present(Widget *widget);
+void request_present_notify(Widget *widget);
+void handle_present_event(Widget *widget, XGenericEventCookie *cookie);
+void arm_frame_timer(Widget *widget, int delay_ms, int interval_ms);
+void schedule_frame(Widget *widget);
+void run_frame(Widget *widget);
 void start_close_animation(Widget *widget);
 void start_show_animation(Widget *widget);
 void draw_widget(Widget *widget);
-void draw_button(Widget *widget, int index);
-void draw_page_indicator(Widget *widget);
+void present_widget(Widget *widget, int x, int y, int width, int height);
+void draw_button(Widget *widget, PageSurface *surface, int index);
+void draw_page_indicator(Widget *widget, PageSurface *surface);
+void get_button_rect(Widget *widget, int page, int index, XRectangle *rect);
+void get_indicator_rect(Widget *widget, XRectangle *rect);
+void push_dot(Widget *widget, int center_x, int center_y, int radius, XColor *color, int outlined);
+void setup_page_cache(Widget *widget);
+void teardown_page_cache(Widget *widget);
+void invalidate_page_cache(Widget *widget);
+void layout_surface(Widget *widget, PageSurface *surface);
+void resize_widget(Widget *widget, int width, int height);
+void hover_zone_span(Widget *widget, int *top, int *bottom);
+PageSurface *get_page_surface(Widget *widget, int page);
+void render_page(Widget *widget, PageSurface *surface);
+void prerender_neighbours(Widget *widget);
+void damage_page(Widget *widget, int page, DamageMask damage);
+void flash_damage(Widget *widget, DamageMask damage);
+void set_page(Widget *widget, int page);
 void cleanup_widget(Widget *widget);
 int check_mouse_in_hover_zone(Widget *widget);
 int check_mouse_over_widget(Widget *widget);
+int point_in_hover_zone(Widget *widget, int x, int y);
+int point_over_widget(Widget *widget, int x, int y);
+void create_hover_window(Widget *widget);
+void keep_hover_window_on_top(Widget *widget, Window changed);
+void update_hover_state(Widget *widget);
 void setup_colors(Widget *widget);
 void setup_fonts(Widget *widget);
-void execute_command(const char *command);
+void start_font_matching(Widget *widget);
+void load_deferred_fonts(Widget *widget);
+void compute_truecolor_pixel(Widget *widget, XColor *color);
+void block_loop_signals(sigset_t *mask);
+void mark_startup_phase(Widget *widget, const char *name);
+void print_startup_report(Widget *widget);
+const char *config_string(const ConfigImage *config, uint32_t offset);
+const ConfigButton *config_buttons(const ConfigImage *config);
+const ConfigPage *config_page(const ConfigImage *config, int page);
+ConfigPage *add_config_page(ConfigBuilder *builder);
+ConfigButton *add_config_button(ConfigBuilder *builder);
+void place_config_buttons(ConfigPage *page, ConfigButton *buttons);
+uint32_t intern_string(ConfigBuilder *builder, const char *string);
+uint32_t string_bucket(const ConfigBuilder *builder, const char *string, size_t length);
+void builtin_config(ConfigBuilder *builder);
+ConfigImage *finish_config(ConfigBuilder *builder, size_t *size);
+void unescape_value(const char *value, char *out, size_t size);
+char *trim(char *string);
+int parse_config(const char *path, ConfigBuilder *builder);
+uint64_t hash_bytes(const void *data, size_t size);
+int data_file_path(char *path, size_t size, const char *variable, const char *fallback,
+                   const char *name, int create);
+int config_cache_path(char *path, size_t size, int create);
+ConfigImage *map_config_cache(const struct stat *source, uint64_t defaults_hash, size_t *size);
+void write_config_cache(ConfigImage *config);
+void resolve_config_path(Widget *widget);
+ConfigImage *load_config(Widget *widget, size_t *size, int *mapped);
+void free_config(ConfigImage *config, size_t size, int mapped);
+int config_page_equal(const ConfigImage *a, const ConfigImage *b, int page);
+void reload_config(Widget *widget);
+void setup_config_watch(Widget *widget);
+void handle_config_change(Widget *widget, int fd, uint32_t events, void *data);
+void print_config(const ConfigImage *config);
+int control_socket_path(struct sockaddr_un *address);
+int claim_instance(Widget *widget);
+int control_client(int count, char **commands);
+void handle_control_listen(Widget *widget, int fd, uint32_t events, void *data);
+void handle_control_client(Widget *widget, int fd, uint32_t events, void *data);
+void run_control_message(Widget *widget, char *message, char *reply, size_t size);
+int find_button(Widget *widget, const char *ref, int *page, int *index);
+void load_page_buttons(Widget *widget, int page);
+void bind_page_buttons(Widget *widget, int page);
+void free_page_buttons(Widget *widget, int page);
+const ConfigButton *button_entry(Widget *widget, int page, int index);
+void release_colors(Widget *widget);
+void close_fonts(Widget *widget);
+void resize_pages(Widget *widget, int count);
+void load_page(Widget *widget, int page);
+void attach_page_sources(Widget *widget, int page);
+void teardown_probes(Widget *widget);
+void teardown_watches(Widget *widget);
+CompiledCommand *compile_command(const char *command);
+int resolve_program(const char *name, char *path, size_t size);
+pid_t execute_command(const CompiledCommand *command);
+void start_button_command(Widget *widget, int page, int index, const CompiledCommand *command);
+void run_button_intent(Widget *widget, int page, int index);
+void cancel_button_command(Button *button);
+void finish_button_command(Widget *widget, int page, int index, int succeeded);
+void reap_children(Widget *widget);
+void record_child_exit(Widget *widget, pid_t pid, int status);
+void start_zygote(Widget *widget);
+void zygote_main(int fd);
+int zygote_spawn(Widget *widget, const CompiledCommand *command, uint32_t seq);
+void handle_zygote(Widget *widget, int fd, uint32_t events, void *data);
+int add_probe(Widget *widget, const char *command);
+void refresh_probes(Widget *widget);
+void start_probe(Widget *widget, Probe *probe);
+void finish_probe(Widget *widget, Probe *probe);
+void apply_probe(Widget *widget, int index);
+void handle_probe_output(Widget *widget, int fd, uint32_t events, void *data);
+void handle_probe_timer(Widget *widget, int fd, uint32_t events, void *data);
+void arm_probe_timer(Widget *widget, int interval_ms);
+int add_live_label(Widget *widget, const char *command);
+void start_live_label(Widget *widget, int index);
+void stop_live_label(Widget *widget, int index);
+void handle_live_output(Widget *widget, int fd, uint32_t events, void *data);
+void schedule_live_flush(Widget *widget);
+void flush_live_labels(Widget *widget);
+void handle_live_timer(Widget *widget, int fd, uint32_t events, void *data);
+int timer_spec_seconds(const char *command);
+void add_timer_time(Widget *widget, int page, int index, int seconds);
+void update_countdowns(Widget *widget);
+int button_on_screen(Widget *widget, int page, int index);
+void handle_countdown_timer(Widget *widget, int fd, uint32_t events, void *data);
+void spawn_detached(Widget *widget, const CompiledCommand *command);
+int open_work_ledger(WorkLedger *work, int writable);
+void close_work_ledger(WorkLedger *work);
+int map_work_index(WorkLedger *work, uint32_t day_count);
+void sync_work_index(WorkLedger *work, int verify);
+int work_index_valid(WorkLedger *work, uint64_t records, int verify);
+int replay_work_records(WorkLedger *work, uint64_t records, int verify);
+int append_work_record(WorkLedger *work, int32_t day, uint32_t seconds, int64_t session);
+void import_work_history(WorkLedger *work);
+int32_t work_day(time_t when);
+uint32_t work_day_total(WorkLedger *work, int32_t day);
+void format_work_time(char *text, size_t size, uint64_t seconds);
+void credit_work_session(WorkLedger *work);
+void start_work_session(Widget *widget, int limit_minutes);
+void stop_work_session(Widget *widget);
+void update_work_buttons(Widget *widget);
+void handle_work_timer(Widget *widget, int fd, uint32_t events, void *data);
+int work_stats(void);
+int is_watch_spec(const char *spec);
+int add_watch(Widget *widget, const char *spec);
+void open_watch_source(Widget *widget, int type);
+void apply_watch(Widget *widget, int index);
+void handle_rfkill(Widget *widget, int fd, uint32_t events, void *data);
+void update_rfkill_watches(Widget *widget);
+void read_file_watch(Widget *widget, int index);
+void handle_inotify(Widget *widget, int fd, uint32_t events, void *data);
+void handle_netlink(Widget *widget, int fd, uint32_t events, void *data);
 void init_buttons(Widget *widget);
 int get_button_at_position(Widget *widget, int x, int y);
-void toggle_button(Widget *widget, int button_index);
+void toggle_button(Widget *widget, int page, int button_index);
+int shown_page(Widget *widget);
+Page *page_slots(Widget *widget, int page);
+void resolve_slot(Widget *widget, int *page, int *index);
+void build_search_index(Widget *widget);
+void free_search_index(Widget *widget);
+const uint32_t *search_postings(Widget *widget, const char *gram, int length, uint32_t *count);
+void start_filter(Widget *widget);
+void stop_filter(Widget *widget);
+void type_filter_char(Widget *widget, char c);
+void erase_filter_char(Widget *widget);
+void update_filter_view(Widget *widget);
+void handle_filter_key(Widget *widget, XKeyEvent *key);
+const char *button_label(Widget *widget, int page, int index);
+void layout_button(Widget *widget, PageSurface *surface, int index);
+void relayout_button(Widget *widget, int page, int index);
 void change_page(Widget *widget, int direction);
-void draw_text_centered_xft(Widget *widget, const char *text, int x, int y, int width, XftFont *font, XftColor *color);
-int check_compositor(Display *display);
+void layout_text(Widget *widget, TextLayout *layout, const char *text, XftFont *font, int y, int width);
+void draw_text_layout(Widget *widget, TextLayout *layout, int x, int y, XftFont *font, XftColor *color);
+void push_rect(Widget *widget, int layer, XColor *color, int x, int y, int width, int height);
+void push_outline(Widget *widget, int layer, XColor *color, int x, int y, int width, int height);
+void submit_render_list(Widget *widget, PageSurface *surface);
+void request_compositor_check(Widget *widget);
+int check_compositor(Widget *widget);
+void poll_pointer(Widget *widget);
 void set_window_opacity(Widget *widget, double opacity);
+void handle_event(Widget *widget, XEvent *event);
+void process_x_events(Widget *widget);
+int loop_add_fd(Widget *widget, int fd, uint32_t events, LoopHandler handler, void *data);
+void loop_remove_fd(Widget *widget, int fd);
+void setup_event_loop(Widget *widget);
+void update_frame_timer(Widget *widget);
+void run_event_loop(Widget *widget);
+
+int resolve_program(const char *name, char *path, size_t size) {
+    if (strchr(name, '/')) {
+        if ((size_t)snprintf(path, size, "%s", name) >= size) return -1;
+        return access(path, X_OK);
+    }
+    
+    const char *dirs = getenv("PATH");
+    if (!dirs) dirs = "/usr/local/bin:/usr/bin:/bin";
+    
+    while (*dirs) {
+        size_t dir_length = strcspn(dirs, ":");
+        int written = dir_length ? snprintf(path, size, "%.*s/%s", (int)dir_length, dirs, name)
+                                 : snprintf(path, size, "%s", name);
+        if (written > 0 && (size_t)written < size && access(path, X_OK) == 0) return 0;
+        dirs += dir_length;
+        if (*dirs == ':') dirs++;
+    }
+    return -1;
+}
+
+CompiledCommand *compile_command(const char *command) {
+    size_t length = strlen(command);
+    if (length == 0) return NULL;
+    
+    // Split into words, expanding a leading ~ the way sh would. Each word
+    // grows by at most $HOME and ends where a separator was, so the
+    // scratch buffer below always has room
+    const char *home = getenv("HOME");
+    size_t home_length = home ? strlen(home) : 0;
+    size_t tildes = 0;
+    for (const char *c = command; (c = strchr(c, '~')); c++) tildes++;
+    
+    char *words = malloc(length + 1 + tildes * home_length);
+    char path[PATH_MAX];
+    int argc = 0, direct = words && !strpbrk(command, SHELL_METACHARACTERS);
+    size_t used = 0;
+    const char *cursor = command;
+    
+    while (direct && *cursor) {
+        cursor += strspn(cursor, " \t");
+        if (!*cursor) break;
+        size_t word_length = strcspn(cursor, " \t");
+        
+        const char *prefix = "";
+        if (cursor[0] == '~' && (word_length == 1 || cursor[1] == '/')) {
+            prefix = home;
+            cursor++;
+            word_length--;
+        }
+        if (!prefix || memchr(cursor, '~', word_length)) direct = 0;
+        if (!direct) break;
+        
+        used += sprintf(words + used, "%s%.*s", prefix, (int)word_length, cursor) + 1;
+        argc++;
+        cursor += word_length;
+    }
+    
+    // Leading assignments change the environment, which only the shell does
+    if (direct && (argc == 0 || strchr(words, '=') || resolve_program(words, path, sizeof(path)) < 0))
+        direct = 0;
+    
+    size_t path_length = direct ? strlen(path) + 1 : 0;
+    size_t buffer_length = direct ? path_length + used : length + 1;
+    size_t argv_size = direct ? (argc + 1) * sizeof(char *) : 0;
+    CompiledCommand *compiled = malloc(sizeof(CompiledCommand) + argv_size + buffer_length);
+    if (!compiled) exit(1);
+    
+    compiled->direct = direct;
+    compiled->length = buffer_length;
+    compiled->argv = direct ? (char **)(compiled + 1) : NULL;
+    compiled->buffer = (char *)(compiled + 1) + argv_size;
+    if (direct) {
+        memcpy(compiled->buffer, path, path_length);
+        memcpy(compiled->buffer + path_length, words, used);
+        char *word = compiled->buffer + path_length;
+        for (int i = 0; i < argc; i++) {
+            compiled->argv[i] = word;
+            word += strlen(word) + 1;
+        }
+        compiled->argv[argc] = NULL;
+    } else {
+        memcpy(compiled->buffer, command, length + 1);
+    }
+    
+    free(words);
+    return compiled;
+}
 
-void execute_command(const char *command) {
-    if (!command[0]) return;
+pid_t execute_command(const CompiledCommand *command) {
+    if (!command) return 0;
     
-    if (fork() == 0) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Signals blocked for the signalfd would otherwise stay blocked in the child
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
         setsid();
-        execl("/bin/sh", "sh", "-c", command, NULL);
-        exit(1);
+        if (command->direct) {
+            execv(command->buffer, command->argv);
+        } else {
+            execl("/bin/sh", "sh", "-c", command->buffer, NULL);
+        }
+        _exit(127);
     }
+    return pid;
 }
 
-void init_buttons(Widget *widget) {
-    // Initialize all pages
-    for (int page = 0; page < MAX_PAGES; page++) {
-        for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
-            // Clear button data
-            widget->buttons[page][i].icon[0] = '\0';
-            widget->buttons[page][i].text[0] = '\0';
-            widget->buttons[page][i].toggle_command[0] = '\0';
-            widget->buttons[page][i].untoggle_command[0] = '\0';
-            widget->buttons[page][i].click_only = 0;
-            widget->buttons[page][i].is_active = 0;
-            widget->buttons[page][i].is_pressed = 0;
+void start_button_command(Widget *widget, int page, int index, const CompiledCommand *command) {
+    Button *button = &widget->pages[page].buttons[index];
+    ButtonCommands *commands = &widget->pages[page].commands[index];
+    
+    button->failed = 0;
+    button->cancelled = 0;
+    commands->spawn_seq = 0;
+    commands->started_us = monotonic_us();
+    damage_page(widget, page, DAMAGE_BUTTON(index));
+    
+    if (!command) {
+        button->pid = 0;
+        return;
+    }
+    
+    uint32_t seq = ++widget->spawn_seq;
+    if (seq == 0) seq = ++widget->spawn_seq;
+    if (zygote_spawn(widget, command, seq) == 0) {
+        button->pid = -1;
+        commands->spawn_seq = seq;
+        return;
+    }
+    
+    // No zygote: fork from here. The report waits on a close-on-exec pipe,
+    // whose write end closes exactly when the child execs
+    int exec_pipe[2] = { -1, -1 };
+    if (widget->spawn_report && pipe2(exec_pipe, O_CLOEXEC) < 0)
+        exec_pipe[0] = exec_pipe[1] = -1;
+    
+    button->pid = execute_command(command);
+    
+    if (exec_pipe[0] >= 0) {
+        char byte;
+        close(exec_pipe[1]);
+        while (read(exec_pipe[0], &byte, 1) < 0 && errno == EINTR);
+        close(exec_pipe[0]);
+        if (button->pid > 0)
+            fprintf(stderr, "swgt: spawn via fork: %.3f ms click-to-exec\n",
+                    (monotonic_us() - commands->started_us) / 1000.0);
+    }
+    
+    if (button->pid < 0)
+        finish_button_command(widget, page, index, 0);
+}
+
+// Each button runs at most one command at a time. is_active holds the state
+// the user last asked for; whatever is in flight is cancelled when that
+// changes, and its exit starts the command for the newest intent.
+void run_button_intent(Widget *widget, int page, int index) {
+    Button *button = &widget->pages[page].buttons[index];
+    ButtonCommands *commands = &widget->pages[page].commands[index];
+    
+    button->target_active = button->is_active;
+    if (button->click_only || button->is_active) {
+        start_button_command(widget, page, index, commands->toggle);
+    } else {
+        start_button_command(widget, page, index, commands->untoggle);
+    }
+}
+
+void cancel_button_command(Button *button) {
+    button->cancelled = 1;
+    
+    // Children lead their own session, so this reaches everything they started;
+    // a launch the zygote has not confirmed yet is signalled when it does.
+    // A forked child may not have called setsid yet, so fall back to the pid
+    if (button->pid > 0 && kill(-button->pid, SIGTERM) < 0)
+        kill(button->pid, SIGTERM);
+}
+
+void finish_button_command(Widget *widget, int page, int index, int succeeded) {
+    Button *button = &widget->pages[page].buttons[index];
+    ButtonCommands *commands = &widget->pages[page].commands[index];
+    
+    button->pid = 0;
+    damage_page(widget, page, DAMAGE_BUTTON(index));
+    
+    // Whatever the probe saw before is out of date now
+    if (commands->probe >= 0)
+        widget->probes[commands->probe].fresh_until_us = 0;
+    
+    if (button->cancelled) {
+        // Its effect is unknown, so the latest intent is applied from scratch
+        button->cancelled = 0;
+        if (!button->click_only) run_button_intent(widget, page, index);
+        return;
+    }
+    
+    // The state shown must match what the command achieved
+    if (!succeeded) {
+        button->failed = 1;
+        if (!button->click_only) button->is_active = !button->target_active;
+    }
+}
+
+void reap_children(Widget *widget) {
+    pid_t pid;
+    int status;
+    
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (pid == widget->zygote_pid) {
+            widget->zygote_pid = 0;
+            continue;
+        }
+        
+        int is_probe = 0;
+        for (int i = 0; i < widget->probe_count; i++) {
+            Probe *probe = &widget->probes[i];
+            if (probe->pid != pid) continue;
+            
+            probe->exited = 1;
+            probe->status = status;
+            finish_probe(widget, probe);
+            is_probe = 1;
+        }
+        if (!is_probe) record_child_exit(widget, pid, status);
+    }
+}
+
+void record_child_exit(Widget *widget, pid_t pid, int status) {
+    for (int i = 0; i < widget->live_count; i++) {
+        if (widget->live_labels[i].pid == pid) widget->live_labels[i].pid = 0;
+    }
+    
+    for (int page = 0; page < widget->total_pages; page++) {
+        for (int i = 0; i < widget->pages[page].button_count; i++) {
+            Button *button = &widget->pages[page].buttons[i];
+            ButtonCommands *commands = &widget->pages[page].commands[i];
+            if (button->pid != pid) continue;
+            
+            commands->last_runtime_us = monotonic_us() - commands->started_us;
+            commands->last_exit = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            
+            if (widget->spawn_report)
+                fprintf(stderr, "swgt: pid %d (%s) exited %d after %lu ms%s\n", (int)pid,
+                        config_string(widget->config, button_entry(widget, page, i)->text),
+                        commands->last_exit, (unsigned long)(commands->last_runtime_us / 1000),
+                        button->cancelled ? ", cancelled" : "");
+            finish_button_command(widget, page, i, commands->last_exit == 0);
         }
     }
+}
+
+void start_zygote(Widget *widget) {
+    int sv[2];
+    
+    widget->zygote_pid = 0;
+    widget->zygote_fd = -1;
+    widget->spawn_seq = 0;
+    if (!USE_ZYGOTE) return;
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) return;
+    
+    // Forked before the display is opened or any thread exists, so the helper
+    // holds no X connection, font caches or pixmaps for children to inherit
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(sv[0]);
+        if (widget->control_fd >= 0) close(widget->control_fd);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
     
-    // Load page configurations
-    for (int page = 0; page < MAX_PAGES; page++) {
-        const struct {
-            char icon[8];
-            char text[32];
-            char toggle_command[256];
-            char untoggle_command[256];
-            int click_only;
-        } *page_config = get_page_config(page);
+    if (pid < 0) {
+        close(sv[0]);
+        return;
+    }
+    widget->zygote_pid = pid;
+    widget->zygote_fd = sv[0];
+}
+
+void zygote_main(int fd) {
+    sigset_t mask, empty;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+    sigemptyset(&empty);
+    
+    int sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sfd < 0) _exit(1);
+    
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    
+    struct pollfd fds[2] = { { fd, POLLIN, 0 }, { sfd, POLLIN, 0 } };
+    ZygoteRequest *request = NULL;
+    size_t request_capacity = 0;
+    char **argv = NULL;
+    
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        
+        if (fds[1].revents & POLLIN) {
+            struct signalfd_siginfo info;
+            while (read(sfd, &info, sizeof(info)) == sizeof(info));
+            
+            pid_t pid;
+            int status;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                ZygoteReport report = { ZYGOTE_EXITED, 0, pid, status, 0, 0 };
+                send(fd, &report, sizeof(report), MSG_NOSIGNAL);
+            }
+        }
+        
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            // Requests are as long as their command; peeking tells the size first.
+            // End of file: swgt has exited, children keep running in their own sessions
+            ssize_t n = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+            if (n <= 0) break;
+            if ((size_t)n + 1 > request_capacity) {
+                request_capacity = n + 1;
+                free(request);
+                free(argv);
+                request = malloc(request_capacity);
+                argv = malloc((request_capacity / 2 + 3) * sizeof(char *));
+                if (!request || !argv) break;
+            }
+            n = recv(fd, request, n, 0);
+            if (n < (ssize_t)offsetof(ZygoteRequest, command)) continue;
+            
+            size_t length = n - offsetof(ZygoteRequest, command);
+            request->command[length] = '\0';
+            
+            const char *path = "/bin/sh";
+            argv[0] = "sh";
+            argv[1] = "-c";
+            argv[2] = request->command;
+            argv[3] = NULL;
+            if (request->direct) {
+                char *word = request->command + strlen(request->command) + 1;
+                int argc = 0;
+                
+                path = request->command;
+                while (word < request->command + length) {
+                    argv[argc++] = word;
+                    word += strlen(word) + 1;
+                }
+                argv[argc] = NULL;
+            }
+            
+            // posix_spawn returns once the child has exec'd, so this is the exec time
+            pid_t pid;
+            int err = posix_spawn(&pid, path, NULL, &attr, argv, environ);
+            
+            ZygoteReport report = { ZYGOTE_SPAWNED, request->seq, err ? 0 : pid, err,
+                                    request->sent_us, monotonic_us() };
+            send(fd, &report, sizeof(report), MSG_NOSIGNAL);
+        }
+    }
+    _exit(0);
+}
+
+int zygote_spawn(Widget *widget, const CompiledCommand *command, uint32_t seq) {
+    if (widget->zygote_fd < 0) return -1;
+    
+    ZygoteRequest request;
+    request.seq = seq;
+    request.direct = command->direct;
+    request.length = command->length;
+    request.sent_us = monotonic_us();
+    
+    // Header and command go out as one datagram without copying the command;
+    // one too big for the socket buffer is forked from here instead
+    struct iovec parts[2] = {
+        { &request, offsetof(ZygoteRequest, command) },
+        { command->buffer, command->length }
+    };
+    struct msghdr message = { .msg_iov = parts, .msg_iovlen = 2 };
+    size_t size = parts[0].iov_len + parts[1].iov_len;
+    if (sendmsg(widget->zygote_fd, &message, MSG_DONTWAIT | MSG_NOSIGNAL) != (ssize_t)size)
+        return -1;
+    return 0;
+}
+
+// Buttons whose probes run the same command share one spawn per refresh.
+// Probes are referred to by index, so the array may grow while they run
+int add_probe(Widget *widget, const char *command) {
+    for (int i = 0; i < widget->probe_count; i++) {
+        if (strcmp(widget->probes[i].command, command) == 0) return i;
+    }
+    
+    if (widget->probe_count == widget->probe_capacity) {
+        widget->probe_capacity = widget->probe_capacity ? widget->probe_capacity * 2 : 8;
+        widget->probes = realloc(widget->probes, widget->probe_capacity * sizeof(Probe));
+        if (!widget->probes) exit(1);
+    }
+    Probe *probe = &widget->probes[widget->probe_count];
+    memset(probe, 0, sizeof(*probe));
+    probe->command = command;
+    probe->compiled = compile_command(command);
+    probe->fd = -1;
+    return widget->probe_count++;
+}
+
+void teardown_probes(Widget *widget) {
+    // Children still running are reaped as strangers once the slots are reused
+    for (int i = 0; i < widget->probe_count; i++) {
+        Probe *probe = &widget->probes[i];
+        free(probe->compiled);
+        if (probe->fd < 0) continue;
+        loop_remove_fd(widget, probe->fd);
+        close(probe->fd);
+    }
+    free(widget->probes);
+    widget->probes = NULL;
+    widget->probe_count = widget->probe_capacity = 0;
+}
+
+void refresh_probes(Widget *widget) {
+    uint64_t now = monotonic_us();
+    
+    for (int i = 0; i < widget->probe_count; i++) {
+        Probe *probe = &widget->probes[i];
+        
+        // One run at a time per probe, and a recent result is reused as is
+        if (probe->pid || now < probe->fresh_until_us) continue;
+        start_probe(widget, probe);
+    }
+}
+
+void start_probe(Widget *widget, Probe *probe) {
+    if (!probe->compiled) return;
+    
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) < 0) return;
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    
+    sigset_t empty;
+    sigemptyset(&empty);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    
+    CompiledCommand *compiled = probe->compiled;
+    char *shell_argv[] = { "sh", "-c", compiled->buffer, NULL };
+    int err = compiled->direct
+        ? posix_spawn(&probe->pid, compiled->buffer, &actions, &attr, compiled->argv, environ)
+        : posix_spawn(&probe->pid, "/bin/sh", &actions, &attr, shell_argv, environ);
+    
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    
+    probe->exited = 0;
+    probe->length = 0;
+    probe->started_us = monotonic_us();
+    
+    if (err) {
+        probe->pid = 0;
+        probe->started_us = 0;
+        close(pipe_fds[0]);
+        return;
+    }
+    if (loop_add_fd(widget, pipe_fds[0], EPOLLIN, handle_probe_output, (void *)(intptr_t)(probe - widget->probes)) < 0) {
+        // Without its output there is no result to apply; it is still reaped
+        kill(probe->pid, SIGTERM);
+        probe->started_us = 0;
+        close(pipe_fds[0]);
+        probe->fd = -1;
+        return;
+    }
+    probe->fd = pipe_fds[0];
+    
+    // Until the answer arrives, buttons showing an expired result are marked stale
+    for (int page = 0; page < widget->total_pages; page++) {
+        for (int i = 0; i < widget->pages[page].button_count; i++) {
+            Button *button = &widget->pages[page].buttons[i];
+            if (widget->pages[page].commands[i].probe != probe - widget->probes) continue;
+            button->stale = 1;
+            damage_page(widget, page, DAMAGE_BUTTON(i));
+        }
+    }
+}
+
+void handle_probe_output(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events;
+    Probe *probe = &widget->probes[(intptr_t)data];
+    char scratch[256];
+    ssize_t n;
+    
+    for (;;) {
+        // Output beyond the buffer is drained and ignored
+        size_t space = sizeof(probe->output) - 1 - probe->length;
+        n = space ? read(fd, probe->output + probe->length, space) : read(fd, scratch, sizeof(scratch));
+        if (n <= 0) break;
+        if (space) probe->length += n;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    
+    loop_remove_fd(widget, fd);
+    close(fd);
+    probe->fd = -1;
+    probe->output[probe->length] = '\0';
+    finish_probe(widget, probe);
+}
+
+void finish_probe(Widget *widget, Probe *probe) {
+    if (!probe->exited || probe->fd >= 0) return;
+    
+    probe->pid = 0;
+    probe->exited = 0;
+    if (!probe->started_us) return;
+    
+    probe->has_result = 1;
+    probe->succeeded = WIFEXITED(probe->status) && WEXITSTATUS(probe->status) == 0;
+    probe->result_started_us = probe->started_us;
+    probe->fresh_until_us = monotonic_us() + (uint64_t)PROBE_TTL_MS * 1000;
+    probe->started_us = 0;
+    apply_probe(widget, probe - widget->probes);
+}
+
+void apply_probe(Widget *widget, int index) {
+    Probe *probe = &widget->probes[index];
+    
+    for (int page = 0; page < widget->total_pages; page++) {
+        for (int i = 0; i < widget->pages[page].button_count; i++) {
+            Button *button = &widget->pages[page].buttons[i];
+            ButtonCommands *commands = &widget->pages[page].commands[i];
+            if (commands->probe != index) continue;
+            
+            button->stale = 0;
+            damage_page(widget, page, DAMAGE_BUTTON(i));
+            
+            // A command started since the probe ran knows better
+            if (button->pid || commands->started_us > probe->result_started_us) continue;
+            
+            const char *match = config_string(widget->config, button_entry(widget, page, i)->match);
+            button->is_active = match[0] ? strstr(probe->output, match) != NULL : probe->succeeded;
+        }
+    }
+}
+
+void handle_probe_timer(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    uint64_t expirations;
+    
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+        refresh_probes(widget);
+}
+
+void arm_probe_timer(Widget *widget, int interval_ms) {
+    if (widget->probe_timer_fd < 0 || widget->probe_count == 0) return;
+    
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = interval_ms / 1000;
+    spec.it_value.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    spec.it_interval = spec.it_value;
+    timerfd_settime(widget->probe_timer_fd, 0, &spec, NULL);
+}
+
+int add_live_label(Widget *widget, const char *command) {
+    int free_slot = -1;
+    for (int i = 0; i < widget->live_count; i++) {
+        LiveLabel *live = &widget->live_labels[i];
+        if (!live->command) {
+            if (free_slot < 0) free_slot = i;
+            continue;
+        }
+        if (strcmp(live->command, command) != 0) continue;
+        
+        // Carried over a reload: only the string moves to the new config
+        live->command = command;
+        live->used = 1;
+        return i;
+    }
+    
+    if (free_slot < 0) {
+        if (widget->live_count == widget->live_capacity) {
+            widget->live_capacity = widget->live_capacity ? widget->live_capacity * 2 : 4;
+            widget->live_labels = realloc(widget->live_labels, widget->live_capacity * sizeof(LiveLabel));
+            if (!widget->live_labels) exit(1);
+        }
+        free_slot = widget->live_count++;
+    }
+    LiveLabel *live = &widget->live_labels[free_slot];
+    memset(live, 0, sizeof(*live));
+    live->command = command;
+    live->compiled = compile_command(command);
+    live->fd = -1;
+    live->used = 1;
+    start_live_label(widget, free_slot);
+    return free_slot;
+}
+
+void start_live_label(Widget *widget, int index) {
+    LiveLabel *live = &widget->live_labels[index];
+    if (!live->compiled) return;
+    
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC | O_NONBLOCK) < 0) return;
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+    
+    // Its own process group, so stopping it also stops whatever it started
+    sigset_t empty;
+    sigemptyset(&empty);
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETPGROUP);
+    posix_spawnattr_setsigmask(&attr, &empty);
+    posix_spawnattr_setpgroup(&attr, 0);
+    
+    CompiledCommand *compiled = live->compiled;
+    char *shell_argv[] = { "sh", "-c", compiled->buffer, NULL };
+    int err = compiled->direct
+        ? posix_spawn(&live->pid, compiled->buffer, &actions, &attr, compiled->argv, environ)
+        : posix_spawn(&live->pid, "/bin/sh", &actions, &attr, shell_argv, environ);
+    
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipe_fds[1]);
+    
+    if (err) {
+        live->pid = 0;
+        close(pipe_fds[0]);
+        return;
+    }
+    if (loop_add_fd(widget, pipe_fds[0], EPOLLIN, handle_live_output, (void *)(intptr_t)index) < 0) {
+        kill(-live->pid, SIGTERM);
+        close(pipe_fds[0]);
+        return;
+    }
+    live->fd = pipe_fds[0];
+}
+
+void stop_live_label(Widget *widget, int index) {
+    LiveLabel *live = &widget->live_labels[index];
+    
+    // The child is reaped as a stranger once it exits
+    if (live->pid > 0) kill(-live->pid, SIGTERM);
+    if (live->fd >= 0) {
+        loop_remove_fd(widget, live->fd);
+        close(live->fd);
+    }
+    free(live->compiled);
+    memset(live, 0, sizeof(*live));
+    live->fd = -1;
+}
+
+void handle_live_output(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events;
+    LiveLabel *live = &widget->live_labels[(intptr_t)data];
+    char buffer[1024];
+    int complete = 0;
+    ssize_t n;
+    
+    // A burst is read whole and only its newest complete line is kept
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i] != '\n') {
+                if (live->length < sizeof(live->line) - 1) live->line[live->length++] = buffer[i];
+                continue;
+            }
+            live->line[live->length] = '\0';
+            live->length = 0;
+            complete = 1;
+            if (strcmp(live->line, live->text) != 0 || !live->has_text) {
+                memcpy(live->text, live->line, sizeof(live->text));
+                live->has_text = 1;
+                live->dirty = 1;
+            }
+        }
+    }
+    if (complete && live->dirty) schedule_live_flush(widget);
+    
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    loop_remove_fd(widget, fd);
+    close(fd);
+    live->fd = -1;
+}
+
+// Hidden, the text just waits for the next show; shown, the first change
+// is laid out at once and any more within the frame on the frame's end
+void schedule_live_flush(Widget *widget) {
+    if (!widget->is_visible && !widget->is_animating) return;
+    
+    uint64_t now = monotonic_us();
+    uint64_t next = widget->live_flushed_us + ANIMATION_SLEEP_MS * 1000;
+    if (now >= next || widget->live_timer_fd < 0) {
+        flush_live_labels(widget);
+        return;
+    }
+    
+    struct itimerspec spec = {0};
+    spec.it_value.tv_nsec = (long)(next - now) * 1000L;
+    timerfd_settime(widget->live_timer_fd, 0, &spec, NULL);
+}
+
+void flush_live_labels(Widget *widget) {
+    widget->live_flushed_us = monotonic_us();
+    
+    for (int live = 0; live < widget->live_count; live++) {
+        if (!widget->live_labels[live].dirty) continue;
+        widget->live_labels[live].dirty = 0;
+        
+        for (int page = 0; page < widget->total_pages; page++) {
+            for (int i = 0; i < widget->pages[page].button_count; i++) {
+                if (widget->pages[page].commands[i].live == live) relayout_button(widget, page, i);
+            }
+        }
+    }
+}
+
+void handle_live_timer(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    uint64_t expirations;
+    
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+    if (widget->is_visible || widget->is_animating) flush_live_labels(widget);
+}
+
+// "timer:SECONDS" as a button command, 0 for any other command
+int timer_spec_seconds(const char *command) {
+    if (strncmp(command, "timer:", 6) != 0) return 0;
+    int seconds = atoi(command + 6);
+    return seconds > 0 ? seconds : 60;
+}
+
+void add_timer_time(Widget *widget, int page, int index, int seconds) {
+    ButtonCommands *commands = &widget->pages[page].commands[index];
+    uint64_t now = monotonic_us();
+    
+    if (seconds <= 0) {
+        commands->timer_deadline_us = 0;
+    } else {
+        if (!commands->timer_deadline_us) {
+            if (widget->timer_count == widget->timer_capacity) {
+                widget->timer_capacity = widget->timer_capacity ? widget->timer_capacity * 2 : 4;
+                widget->timers = realloc(widget->timers, widget->timer_capacity * sizeof(TimerRef));
+                if (!widget->timers) exit(1);
+            }
+            widget->timers[widget->timer_count++] = (TimerRef){ page, index };
+        }
+        if (commands->timer_deadline_us < now) commands->timer_deadline_us = now;
+        commands->timer_deadline_us += (uint64_t)seconds * 1000000;
+    }
+    widget->pages[page].buttons[index].is_active = commands->timer_deadline_us != 0;
+    damage_page(widget, page, DAMAGE_BUTTON(index));
+    
+    // A new countdown is laid out by the update, a stopped one goes back to its label
+    commands->countdown[0] = '\0';
+    if (!commands->timer_deadline_us) relayout_button(widget, page, index);
+    update_countdowns(widget);
+}
+
+// Ends expired countdowns and lays out the on-screen ones whose seconds
+// changed. The timer is then armed for the next second that changes on
+// screen, or else for the next end, so countdowns out of sight cost no
+// wakeups; they are laid out once their page is shown
+void update_countdowns(Widget *widget) {
+    uint64_t now = monotonic_us();
+    uint64_t next = 0;
+    
+    for (int t = 0; t < widget->timer_count; t++) {
+        int page = widget->timers[t].page, i = widget->timers[t].index;
+        ButtonCommands *commands = page < widget->total_pages && i < widget->pages[page].button_count
+            ? &widget->pages[page].commands[i] : NULL;
+        
+        // Stopped, ended, or dropped with its page on a reload
+        if (!commands || !commands->timer_deadline_us || commands->timer_deadline_us <= now) {
+            widget->timers[t--] = widget->timers[--widget->timer_count];
+            if (!commands || !commands->timer_deadline_us) continue;
+            
+            commands->timer_deadline_us = 0;
+            widget->pages[page].buttons[i].is_active = 0;
+            relayout_button(widget, page, i);
+            
+            // The hook fires once per countdown
+            spawn_detached(widget, widget->timer_notify);
+            continue;
+        }
+        
+        // Remaining time is shown in whole seconds, rounded up
+        uint64_t left = commands->timer_deadline_us - now;
+        int visible = button_on_screen(widget, page, i);
+        uint64_t wake = visible ? (left - 1) % 1000000 + 1 : left;
+        if (!next || wake < next) next = wake;
+        if (!visible) continue;
+        
+        char text[COUNTDOWN_SIZE];
+        unsigned seconds = (unsigned)((left + 999999) / 1000000);
+        if (seconds >= 3600) {
+            snprintf(text, sizeof(text), "%u:%02u:%02u", seconds / 3600, seconds / 60 % 60, seconds % 60);
+        } else {
+            snprintf(text, sizeof(text), "%u:%02u", seconds / 60, seconds % 60);
+        }
+        if (strcmp(text, commands->countdown) == 0) continue;
+        memcpy(commands->countdown, text, sizeof(text));
+        relayout_button(widget, page, i);
+    }
+    
+    if (widget->countdown_timer_fd < 0) return;
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = next / 1000000;
+    spec.it_value.tv_nsec = (long)(next % 1000000) * 1000L;
+    timerfd_settime(widget->countdown_timer_fd, 0, &spec, NULL);
+}
+
+// Whether the button is drawn right now, on its page or among filter results
+int button_on_screen(Widget *widget, int page, int index) {
+    if (!widget->is_visible && !widget->is_animating) return 0;
+    if (!widget->filter.active) return page == widget->current_page;
+    
+    for (int i = 0; i < widget->filter.view.button_count; i++) {
+        const ConfigButton *entry = &config_buttons(widget->config)[widget->filter.shown[i]];
+        if ((int)entry->page == page && (int)entry->slot == index) return 1;
+    }
+    return 0;
+}
+
+void handle_countdown_timer(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    uint64_t expirations;
+    
+    if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+        update_countdowns(widget);
+}
+
+// Runs a hook nobody waits for, through the zygote when there is one
+void spawn_detached(Widget *widget, const CompiledCommand *command) {
+    if (!command) return;
+    
+    // A sequence number no button holds, so the answer is dropped
+    uint32_t seq = ++widget->spawn_seq;
+    if (seq == 0) seq = ++widget->spawn_seq;
+    if (zygote_spawn(widget, command, seq) < 0)
+        execute_command(command);
+}
+
+int open_work_ledger(WorkLedger *work, int writable) {
+    char path[PATH_MAX];
+    if (data_file_path(path, sizeof(path), "XDG_DATA_HOME", ".local/share", "work.ledger", writable) < 0)
+        return -1;
+    work->fd = open(path, writable ? O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0600);
+    if (work->fd < 0) return -1;
+    
+    // A record torn by a crash is dropped, so appends stay aligned
+    struct stat info;
+    if (fstat(work->fd, &info) < 0) {
+        close_work_ledger(work);
+        return -1;
+    }
+    off_t size = info.st_size - info.st_size % sizeof(WorkRecord);
+    if (writable && size != info.st_size && ftruncate(work->fd, size) < 0) {
+        close_work_ledger(work);
+        return -1;
+    }
+    
+    // Appends continue the running total of the last record
+    WorkRecord last;
+    work->ledger_total = 0;
+    if (size > 0 && pread(work->fd, &last, sizeof(last), size - sizeof(last)) == sizeof(last))
+        work->ledger_total = last.total;
+    if (writable && size == 0) import_work_history(work);
+    
+    if (data_file_path(path, sizeof(path), "XDG_CACHE_HOME", ".cache", "work.index", 1) < 0 ||
+        (work->index_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0) {
+        close_work_ledger(work);
+        return -1;
+    }
+    sync_work_index(work, 1);
+    if (!work->index) {
+        close_work_ledger(work);
+        return -1;
+    }
+    return 0;
+}
+
+void close_work_ledger(WorkLedger *work) {
+    if (work->index) munmap(work->index, work->index_size);
+    if (work->index_fd >= 0) close(work->index_fd);
+    if (work->fd >= 0) close(work->fd);
+    work->index = NULL;
+    work->index_size = 0;
+    work->fd = work->index_fd = -1;
+}
+
+// Maps the index with room for at least DAY_COUNT days; another process
+// may have grown the file, which is then mapped whole
+int map_work_index(WorkLedger *work, uint32_t day_count) {
+    size_t needed = sizeof(WorkIndex) + (size_t)day_count * sizeof(uint32_t);
+    struct stat info;
+    if (fstat(work->index_fd, &info) < 0) return -1;
+    
+    size_t size = info.st_size;
+    if (size < needed) {
+        size = needed + WORK_INDEX_SLACK * sizeof(uint32_t);
+        if (ftruncate(work->index_fd, size) < 0) return -1;
+    }
+    if (work->index && size == work->index_size) return 0;
+    
+    if (work->index) munmap(work->index, work->index_size);
+    work->index = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, work->index_fd, 0);
+    if (work->index == MAP_FAILED) {
+        work->index = NULL;
+        work->index_size = 0;
+        return -1;
+    }
+    work->index_size = size;
+    return 0;
+}
+
+// Adds the records appended since the last call. A missing or foreign
+// index, or with VERIFY one failing its checks, is rebuilt from the ledger
+void sync_work_index(WorkLedger *work, int verify) {
+    struct stat info;
+    if (fstat(work->fd, &info) < 0) return;
+    
+    // The running widget and "swgt stats" may both bring it up to date
+    flock(work->index_fd, LOCK_EX);
+    replay_work_records(work, info.st_size / sizeof(WorkRecord), verify);
+    flock(work->index_fd, LOCK_UN);
+}
+
+// The cheap checks run on every lookup. VERIFY adds one ledger read and a
+// pass over the days, so it is left to opening
+int work_index_valid(WorkLedger *work, uint64_t records, int verify) {
+    WorkIndex *index = work->index;
+    if (index->magic != WORK_INDEX_MAGIC || index->version != WORK_INDEX_VERSION ||
+        index->records > records ||
+        sizeof(WorkIndex) + (size_t)index->day_count * sizeof(uint32_t) > work->index_size) return 0;
+    if (!verify) return 1;
+    
+    WorkRecord last = {0};
+    if (index->records > 0 &&
+        pread(work->fd, &last, sizeof(last), (index->records - 1) * sizeof(WorkRecord)) != sizeof(last)) return 0;
+    if (last.total != index->total) return 0;
+    
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < index->day_count; i++) {
+        sum += index->totals[i];
+    }
+    return sum == index->total;
+}
+
+int replay_work_records(WorkLedger *work, uint64_t records, int verify) {
+    if (map_work_index(work, 0) < 0) return -1;
+    
+    if (!work_index_valid(work, records, verify)) {
+        munmap(work->index, work->index_size);
+        work->index = NULL;
+        if (ftruncate(work->index_fd, 0) < 0 || map_work_index(work, 0) < 0) return -1;
+        work->index->magic = WORK_INDEX_MAGIC;
+        work->index->version = WORK_INDEX_VERSION;
+    }
+    
+    WorkRecord batch[256];
+    while (work->index->records < records) {
+        uint64_t count = records - work->index->records;
+        if (count > 256) count = 256;
+        ssize_t n = pread(work->fd, batch, count * sizeof(WorkRecord), work->index->records * sizeof(WorkRecord));
+        if (n < (ssize_t)sizeof(WorkRecord)) return -1;
+        
+        for (size_t i = 0; i < (size_t)n / sizeof(WorkRecord); i++) {
+            int32_t day = batch[i].day;
+            WorkIndex *index = work->index;
+            if (index->day_count == 0) index->first_day = day;
+            
+            // Days before the first one, after a clock change, shift the totals up
+            if (day < index->first_day) {
+                uint32_t shift = index->first_day - day;
+                if (map_work_index(work, index->day_count + shift) < 0) return -1;
+                index = work->index;
+                memmove(index->totals + shift, index->totals, index->day_count * sizeof(uint32_t));
+                memset(index->totals, 0, shift * sizeof(uint32_t));
+                index->first_day = day;
+                index->day_count += shift;
+            }
+            if ((uint32_t)(day - index->first_day) >= index->day_count) {
+                if (map_work_index(work, day - index->first_day + 1) < 0) return -1;
+                index = work->index;
+                index->day_count = day - index->first_day + 1;
+            }
+            index->totals[day - index->first_day] += batch[i].seconds;
+            index->total += batch[i].seconds;
+            index->records++;
+        }
+    }
+    return 0;
+}
+
+// One write of one record, so a reader never sees half of it
+int append_work_record(WorkLedger *work, int32_t day, uint32_t seconds, int64_t session) {
+    WorkRecord record = { day, seconds, session, work->ledger_total + seconds };
+    if (write(work->fd, &record, sizeof(record)) != (ssize_t)sizeof(record)) return -1;
+    work->ledger_total = record.total;
+    return 0;
+}
+
+// A new ledger starts with the "#__WORK_STATE__ YYYY-MM-DD MINUTES" lines
+// the old productivity script kept, now in scripts/work_history
+void import_work_history(WorkLedger *work) {
+    char path[PATH_MAX];
+    const char *home = getenv("HOME");
+    if (strncmp(WORK_HISTORY_FILE, "~/", 2) == 0) {
+        if (!home) return;
+        snprintf(path, sizeof(path), "%s%s", home, WORK_HISTORY_FILE + 1);
+    } else {
+        snprintf(path, sizeof(path), "%s", WORK_HISTORY_FILE);
+    }
+    
+    FILE *file = path[0] ? fopen(path, "r") : NULL;
+    if (!file) return;
+    
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        struct tm date = {0};
+        unsigned minutes;
+        if (sscanf(line, "#__WORK_STATE__ %d-%d-%d %u", &date.tm_year, &date.tm_mon, &date.tm_mday, &minutes) != 4 ||
+            minutes == 0) continue;
+        
+        // Local day numbers count the local date's days, the same as its UTC midnight
+        date.tm_year -= 1900;
+        date.tm_mon -= 1;
+        append_work_record(work, (int32_t)(timegm(&date) / 86400), minutes * 60, 0);
+    }
+    fclose(file);
+    fdatasync(work->fd);
+}
+
+int32_t work_day(time_t when) {
+    struct tm local;
+    localtime_r(&when, &local);
+    return (int32_t)((when + local.tm_gmtoff) / 86400);
+}
+
+uint32_t work_day_total(WorkLedger *work, int32_t day) {
+    sync_work_index(work, 0);
+    WorkIndex *index = work->index;
+    if (!index || index->day_count == 0 || day < index->first_day ||
+        (uint32_t)(day - index->first_day) >= index->day_count) return 0;
+    return index->totals[day - index->first_day];
+}
+
+void format_work_time(char *text, size_t size, uint64_t seconds) {
+    unsigned minutes = (unsigned)(seconds / 60);
+    if (minutes >= 60) {
+        snprintf(text, size, "%uh%02u", minutes / 60, minutes % 60);
+    } else {
+        snprintf(text, size, "%um", minutes);
+    }
+}
+
+// Writes the session time not yet in the ledger, in whole seconds
+void credit_work_session(WorkLedger *work) {
+    if (!work->session || work->fd < 0) return;
+    
+    uint64_t elapsed_us = monotonic_us() - work->started_us;
+    uint32_t seconds = (uint32_t)((elapsed_us - work->credited_us) / 1000000);
+    if (seconds == 0) return;
+    
+    if (append_work_record(work, work_day(time(NULL)), seconds, (int64_t)work->session) < 0) return;
+    
+    // On disk before it counts as credited, so even a power loss costs at most the minute
+    fdatasync(work->fd);
+    work->credited_us += (uint64_t)seconds * 1000000;
+}
+
+void start_work_session(Widget *widget, int limit_minutes) {
+    WorkLedger *work = &widget->work;
+    if (work->fd < 0) return;
+    
+    work->session = time(NULL);
+    work->started_us = monotonic_us();
+    work->credited_us = 0;
+    work->limit_minutes = limit_minutes;
+    
+    if (widget->work_timer_fd >= 0) {
+        struct itimerspec spec = {0};
+        spec.it_value.tv_sec = spec.it_interval.tv_sec = 60;
+        timerfd_settime(widget->work_timer_fd, 0, &spec, NULL);
+    }
+    update_work_buttons(widget);
+}
+
+void stop_work_session(Widget *widget) {
+    credit_work_session(&widget->work);
+    widget->work.session = 0;
+    
+    if (widget->work_timer_fd >= 0) {
+        struct itimerspec spec = {0};
+        timerfd_settime(widget->work_timer_fd, 0, &spec, NULL);
+    }
+    update_work_buttons(widget);
+}
+
+// Shows today's total and the session state on every work button
+void update_work_buttons(Widget *widget) {
+    char label[COUNTDOWN_SIZE];
+    format_work_time(label, sizeof(label), work_day_total(&widget->work, work_day(time(NULL))));
+    int changed = strcmp(label, widget->work.label) != 0;
+    memcpy(widget->work.label, label, sizeof(label));
+    
+    for (int page = 0; page < widget->total_pages; page++) {
+        for (int i = 0; i < widget->pages[page].button_count; i++) {
+            if (widget->pages[page].commands[i].work < 0) continue;
+            
+            Button *button = &widget->pages[page].buttons[i];
+            if (button->is_active != (widget->work.session != 0)) {
+                button->is_active = widget->work.session != 0;
+                damage_page(widget, page, DAMAGE_BUTTON(i));
+            }
+            if (changed) relayout_button(widget, page, i);
+        }
+    }
+}
+
+void handle_work_timer(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    uint64_t expirations;
+    
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) return;
+    if (!widget->work.session) return;
+    
+    credit_work_session(&widget->work);
+    WorkLedger *work = &widget->work;
+    if (work->limit_minutes > 0 && monotonic_us() - work->started_us >= (uint64_t)work->limit_minutes * 60000000) {
+        stop_work_session(widget);
+        spawn_detached(widget, widget->work_notify);
+        return;
+    }
+    
+    // Hidden, the label is brought up to date on the next show
+    if (widget->is_visible || widget->is_animating) update_work_buttons(widget);
+}
+
+// "swgt stats": totals come from the index, whose size is the number of
+// days, not of records
+int work_stats(void) {
+    WorkLedger work;
+    memset(&work, 0, sizeof(work));
+    work.fd = work.index_fd = -1;
+    if (open_work_ledger(&work, 0) < 0 || work.index->day_count == 0) {
+        printf("No work sessions recorded.\n");
+        close_work_ledger(&work);
+        return 0;
+    }
+    
+    WorkIndex *index = work.index;
+    int32_t today = work_day(time(NULL));
+    uint64_t week = 0, month = 0, total = 0;
+    uint32_t days = 0, best = 0;
+    int32_t best_day = 0;
+    for (uint32_t i = 0; i < index->day_count; i++) {
+        int32_t day = index->first_day + (int32_t)i;
+        uint32_t seconds = index->totals[i];
+        if (!seconds) continue;
+        
+        total += seconds;
+        days++;
+        if (day > today - 7 && day <= today) week += seconds;
+        if (day > today - 30 && day <= today) month += seconds;
+        if (seconds > best) {
+            best = seconds;
+            best_day = day;
+        }
+    }
+    
+    char text[COUNTDOWN_SIZE], date[32];
+    format_work_time(text, sizeof(text), work_day_total(&work, today));
+    printf("today          %s\n", text);
+    format_work_time(text, sizeof(text), week);
+    printf("last 7 days    %s\n", text);
+    format_work_time(text, sizeof(text), month);
+    printf("last 30 days   %s\n", text);
+    format_work_time(text, sizeof(text), total);
+    printf("all time       %s on %u days\n", text, days);
+    
+    // Day numbers are local, so the UTC date of their midnight is the local date
+    time_t midnight = (time_t)best_day * 86400;
+    struct tm date_tm;
+    gmtime_r(&midnight, &date_tm);
+    strftime(date, sizeof(date), "%Y-%m-%d", &date_tm);
+    format_work_time(text, sizeof(text), best);
+    printf("best day       %s  %s\n\n", date, text);
+    
+    for (int32_t day = today - 6; day <= today; day++) {
+        midnight = (time_t)day * 86400;
+        gmtime_r(&midnight, &date_tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %a", &date_tm);
+        format_work_time(text, sizeof(text), work_day_total(&work, day));
+        printf("%s  %s\n", date, text);
+    }
+    
+    close_work_ledger(&work);
+    return 0;
+}
+
+int is_watch_spec(const char *spec) {
+    return strncmp(spec, "rfkill:", 7) == 0 || strncmp(spec, "file:", 5) == 0 || strncmp(spec, "link:", 5) == 0;
+}
+
+// Sources are opened when the first watch needing them is added; the
+// dedup by spec means buttons sharing one follow the same state
+int add_watch(Widget *widget, const char *spec) {
+    static const char *rfkill_types[] = {
+        [RFKILL_TYPE_ALL] = "all", [RFKILL_TYPE_WLAN] = "wlan", [RFKILL_TYPE_BLUETOOTH] = "bluetooth",
+        [RFKILL_TYPE_UWB] = "uwb", [RFKILL_TYPE_WIMAX] = "wimax", [RFKILL_TYPE_WWAN] = "wwan",
+        [RFKILL_TYPE_GPS] = "gps", [RFKILL_TYPE_FM] = "fm", [RFKILL_TYPE_NFC] = "nfc"
+    };
+    const char *root = getenv("SWGT_WATCH_ROOT");
+    
+    for (int i = 0; i < widget->watch_count; i++) {
+        if (strcmp(widget->watches[i].spec, spec) == 0) return i;
+    }
+    
+    if (widget->watch_count == widget->watch_capacity) {
+        widget->watch_capacity = widget->watch_capacity ? widget->watch_capacity * 2 : 8;
+        widget->watches = realloc(widget->watches, widget->watch_capacity * sizeof(WatchSource));
+        if (!widget->watches) exit(1);
+    }
+    WatchSource *watch = &widget->watches[widget->watch_count];
+    const char *arg = strchr(spec, ':') + 1;
+    memset(watch, 0, sizeof(*watch));
+    watch->spec = spec;
+    watch->wd = -1;
+    
+    if (spec[0] == 'r') {
+        watch->type = WATCH_RFKILL;
+        watch->rfkill_type = -1;
+        for (int t = 0; t < (int)(sizeof(rfkill_types) / sizeof(rfkill_types[0])); t++) {
+            if (rfkill_types[t] && strcmp(rfkill_types[t], arg) == 0) watch->rfkill_type = t;
+        }
+        if (watch->rfkill_type < 0) return -1;
+    } else if (spec[0] == 'f') {
+        // The root override lets fake trees stand in for /sys, /proc or /tmp
+        watch->type = WATCH_FILE;
+        if ((size_t)snprintf(watch->path, sizeof(watch->path), "%s%s", root ? root : "", arg) >= sizeof(watch->path))
+            return -1;
+    } else {
+        watch->type = WATCH_LINK;
+        if ((size_t)snprintf(watch->path, sizeof(watch->path), "%s", arg) >= sizeof(watch->path))
+            return -1;
+    }
+    
+    int index = widget->watch_count++;
+    switch (watch->type) {
+        case WATCH_RFKILL:
+            // Opening replays every device; once open, the devices already known answer
+            if (widget->rfkill_fd < 0) open_watch_source(widget, WATCH_RFKILL);
+            else update_rfkill_watches(widget);
+            break;
+        case WATCH_FILE: {
+            if (widget->inotify_fd < 0) open_watch_source(widget, WATCH_FILE);
+            
+            // Watching the directory also catches the file being created or removed
+            char dir[sizeof(watch->path)];
+            strcpy(dir, watch->path);
+            char *slash = strrchr(dir, '/');
+            watch->name = strrchr(watch->path, '/') ? strrchr(watch->path, '/') + 1 : watch->path;
+            if (slash) *slash = '\0';
+            
+            if (widget->inotify_fd >= 0) {
+                watch->wd = inotify_add_watch(widget->inotify_fd, slash ? (dir[0] ? dir : "/") : ".",
+                                              IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM |
+                                              IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB);
+            }
+            read_file_watch(widget, index);
+            break;
+        }
+        case WATCH_LINK:
+            // Every new interface asks for a fresh dump; the answer covers all of them
+            open_watch_source(widget, WATCH_LINK);
+            break;
+    }
+    return index;
+}
+
+void open_watch_source(Widget *widget, int type) {
+    if (type == WATCH_RFKILL) {
+        const char *device = getenv("SWGT_RFKILL_DEVICE");
+        widget->rfkill_fd = open(device ? device : RFKILL_DEVICE, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (widget->rfkill_fd >= 0) {
+            // Opening replays every existing device as an add event
+            handle_rfkill(widget, widget->rfkill_fd, EPOLLIN, NULL);
+            if (widget->rfkill_fd >= 0 &&
+                loop_add_fd(widget, widget->rfkill_fd, EPOLLIN, handle_rfkill, NULL) < 0) {
+                close(widget->rfkill_fd);
+                widget->rfkill_fd = -1;
+            }
+        }
+    }
+    
+    if (type == WATCH_FILE) {
+        widget->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (widget->inotify_fd >= 0 &&
+            loop_add_fd(widget, widget->inotify_fd, EPOLLIN, handle_inotify, NULL) < 0) {
+            close(widget->inotify_fd);
+            widget->inotify_fd = -1;
+        }
+    }
+    
+    if (type == WATCH_LINK) {
+        struct sockaddr_nl address = { .nl_family = AF_NETLINK, .nl_groups = RTMGRP_LINK };
+        struct {
+            struct nlmsghdr header;
+            struct ifinfomsg info;
+        } request = {
+            .header = { .nlmsg_len = sizeof(request), .nlmsg_type = RTM_GETLINK,
+                        .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP, .nlmsg_seq = 1 },
+            .info = { .ifi_family = AF_UNSPEC }
+        };
+        
+        if (widget->netlink_fd < 0) {
+            widget->netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+            if (widget->netlink_fd >= 0 &&
+                (bind(widget->netlink_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+                 loop_add_fd(widget, widget->netlink_fd, EPOLLIN, handle_netlink, NULL) < 0)) {
+                close(widget->netlink_fd);
+                widget->netlink_fd = -1;
+            }
+        }
+        
+        // The dump answers asynchronously, like every later notification
+        if (widget->netlink_fd >= 0)
+            send(widget->netlink_fd, &request, sizeof(request), 0);
+    }
+}
+
+void teardown_watches(Widget *widget) {
+    int *fds[] = { &widget->rfkill_fd, &widget->inotify_fd, &widget->netlink_fd };
+    for (int i = 0; i < (int)(sizeof(fds) / sizeof(fds[0])); i++) {
+        if (*fds[i] < 0) continue;
+        loop_remove_fd(widget, *fds[i]);
+        close(*fds[i]);
+        *fds[i] = -1;
+    }
+    free(widget->watches);
+    widget->watches = NULL;
+    widget->watch_count = widget->watch_capacity = 0;
+    widget->rfkill_device_count = 0;
+}
+
+void apply_watch(Widget *widget, int index) {
+    WatchSource *watch = &widget->watches[index];
+    
+    for (int page = 0; page < widget->total_pages; page++) {
+        for (int i = 0; i < widget->pages[page].button_count; i++) {
+            Button *button = &widget->pages[page].buttons[i];
+            if (widget->pages[page].commands[i].watch != index || button->pid) continue;
+            
+            int active = 0;
+            const char *match = config_string(widget->config, button_entry(widget, page, i)->match);
+            switch (watch->type) {
+                case WATCH_RFKILL:
+                    active = watch->blocked;
+                    break;
+                case WATCH_FILE:
+                    active = watch->exists && (!match[0] || strstr(watch->content, match));
+                    break;
+                case WATCH_LINK:
+                    if (!match[0] || strcmp(match, "up") == 0) active = (watch->flags & IFF_UP) != 0;
+                    else if (strcmp(match, "running") == 0) active = (watch->flags & IFF_RUNNING) != 0;
+                    else if (strcmp(match, "down") == 0) active = !(watch->flags & IFF_UP);
+                    break;
+            }
+            
+            if (button->is_active != active) {
+                button->is_active = active;
+                damage_page(widget, page, DAMAGE_BUTTON(i));
+            }
+        }
+    }
+}
+
+void handle_rfkill(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    struct rfkill_event event;
+    ssize_t n;
+    
+    while ((n = read(fd, &event, sizeof(event))) >= (ssize_t)RFKILL_EVENT_SIZE_V1) {
+        int slot = -1;
+        for (int i = 0; i < widget->rfkill_device_count; i++) {
+            if (widget->rfkill_devices[i].idx == event.idx) slot = i;
+        }
+        
+        if (event.op == RFKILL_OP_DEL) {
+            if (slot >= 0) widget->rfkill_devices[slot] = widget->rfkill_devices[--widget->rfkill_device_count];
+            continue;
+        }
+        if (slot < 0) {
+            if (widget->rfkill_device_count == MAX_RFKILL_DEVICES) continue;
+            slot = widget->rfkill_device_count++;
+        }
+        widget->rfkill_devices[slot] = event;
+    }
+    update_rfkill_watches(widget);
+    
+    // End of file only happens on a stand-in such as a FIFO whose writer left
+    if (n == 0 && fd == widget->rfkill_fd) {
+        loop_remove_fd(widget, fd);
+        close(fd);
+        widget->rfkill_fd = -1;
+    }
+}
+
+void update_rfkill_watches(Widget *widget) {
+    // A type is blocked when it has devices and every one of them is blocked
+    for (int i = 0; i < widget->watch_count; i++) {
+        WatchSource *watch = &widget->watches[i];
+        if (watch->type != WATCH_RFKILL) continue;
+        
+        int devices = 0, blocked = 0;
+        for (int j = 0; j < widget->rfkill_device_count; j++) {
+            struct rfkill_event *device = &widget->rfkill_devices[j];
+            if (watch->rfkill_type != RFKILL_TYPE_ALL && device->type != watch->rfkill_type) continue;
+            devices++;
+            if (device->soft || device->hard) blocked++;
+        }
+        watch->blocked = devices > 0 && blocked == devices;
+        apply_watch(widget, i);
+    }
+}
+
+void read_file_watch(Widget *widget, int index) {
+    WatchSource *watch = &widget->watches[index];
+    int fd = open(watch->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    
+    watch->exists = fd >= 0;
+    watch->content[0] = '\0';
+    if (fd >= 0) {
+        ssize_t n = read(fd, watch->content, sizeof(watch->content) - 1);
+        watch->content[n > 0 ? n : 0] = '\0';
+        close(fd);
+    }
+    apply_watch(widget, index);
+}
+
+void handle_inotify(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *cursor = buffer; cursor < buffer + n; ) {
+            struct inotify_event *event = (struct inotify_event *)cursor;
+            cursor += sizeof(*event) + event->len;
+            
+            for (int i = 0; i < widget->watch_count; i++) {
+                WatchSource *watch = &widget->watches[i];
+                if (watch->type != WATCH_FILE) continue;
+                
+                // An overflow loses events, so everything is read again
+                if (event->mask & IN_Q_OVERFLOW ||
+                    (event->wd == watch->wd && (!event->len || strcmp(event->name, watch->name) == 0)))
+                    read_file_watch(widget, i);
+            }
+        }
+    }
+}
+
+void handle_netlink(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    char buffer[8192] __attribute__((aligned(__alignof__(struct nlmsghdr))));
+    ssize_t n;
+    
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        for (struct nlmsghdr *header = (struct nlmsghdr *)buffer; NLMSG_OK(header, (size_t)n);
+             header = NLMSG_NEXT(header, n)) {
+            if (header->nlmsg_type == NLMSG_DONE) {
+                // Interfaces missing from the dump count as down
+                for (int i = 0; i < widget->watch_count; i++) {
+                    if (widget->watches[i].type == WATCH_LINK) apply_watch(widget, i);
+                }
+                continue;
+            }
+            if (header->nlmsg_type != RTM_NEWLINK && header->nlmsg_type != RTM_DELLINK) continue;
+            
+            struct ifinfomsg *info = NLMSG_DATA(header);
+            int length = IFLA_PAYLOAD(header);
+            const char *name = NULL;
+            for (struct rtattr *attr = IFLA_RTA(info); RTA_OK(attr, length); attr = RTA_NEXT(attr, length)) {
+                if (attr->rta_type == IFLA_IFNAME) name = RTA_DATA(attr);
+            }
+            if (!name) continue;
+            
+            for (int i = 0; i < widget->watch_count; i++) {
+                WatchSource *watch = &widget->watches[i];
+                if (watch->type != WATCH_LINK || strcmp(watch->path, name) != 0) continue;
+                
+                watch->flags = header->nlmsg_type == RTM_NEWLINK ? info->ifi_flags : 0;
+                apply_watch(widget, i);
+            }
+        }
+    }
+}
+
+void handle_zygote(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)data;
+    ZygoteReport report;
+    ssize_t n;
+    
+    while ((n = recv(fd, &report, sizeof(report), MSG_DONTWAIT)) == sizeof(report)) {
+        if (report.type == ZYGOTE_EXITED) {
+            record_child_exit(widget, report.pid, report.status);
+            continue;
+        }
+        
+        for (int page = 0; page < widget->total_pages; page++) {
+            for (int i = 0; i < widget->pages[page].button_count; i++) {
+                Button *button = &widget->pages[page].buttons[i];
+                ButtonCommands *commands = &widget->pages[page].commands[i];
+                if (commands->spawn_seq != report.seq) continue;
+                
+                commands->spawn_seq = 0;
+                if (report.status == 0) {
+                    button->pid = report.pid;
+                    if (button->cancelled) kill(-button->pid, SIGTERM);
+                } else {
+                    finish_button_command(widget, page, i, 0);
+                }
+            }
+        }
+        
+        if (widget->spawn_report && report.status == 0) {
+            fprintf(stderr, "swgt: spawn via zygote: %.3f ms click-to-exec\n",
+                    (report.spawned_us - report.sent_us) / 1000.0);
+        }
+    }
+    
+    // The helper is gone; later clicks fork from swgt directly
+    if (n == 0 || (events & (EPOLLHUP | EPOLLERR))) {
+        loop_remove_fd(widget, fd);
+        close(fd);
+        widget->zygote_fd = -1;
+    }
+}
+
+const char *config_string(const ConfigImage *config, uint32_t offset) {
+    return (const char *)config + config->strings_offset + offset;
+}
+
+const ConfigButton *config_buttons(const ConfigImage *config) {
+    return (const ConfigButton *)((const char *)config + config->buttons_offset);
+}
+
+const ConfigPage *config_page(const ConfigImage *config, int page) {
+    if (page < 0 || page >= (int)config->page_count) return NULL;
+    return (const ConfigPage *)((const char *)config + config->pages_offset) + page;
+}
+
+ConfigPage *add_config_page(ConfigBuilder *builder) {
+    if (builder->page_count == builder->page_capacity) {
+        builder->page_capacity = builder->page_capacity ? builder->page_capacity * 2 : 8;
+        builder->pages = realloc(builder->pages, builder->page_capacity * sizeof(ConfigPage));
+        if (!builder->pages) exit(1);
+    }
+    ConfigPage *page = &builder->pages[builder->page_count++];
+    memset(page, 0, sizeof(*page));
+    page->columns = PAGE_COLUMNS;
+    return page;
+}
+
+ConfigButton *add_config_button(ConfigBuilder *builder) {
+    if (builder->button_count == builder->button_capacity) {
+        builder->button_capacity = builder->button_capacity ? builder->button_capacity * 2 : 16;
+        builder->buttons = realloc(builder->buttons, builder->button_capacity * sizeof(ConfigButton));
+        if (!builder->buttons) exit(1);
+    }
+    ConfigButton *button = &builder->buttons[builder->button_count++];
+    memset(button, 0, sizeof(*button));
+    button->width = button->height = 1;
+    return button;
+}
+
+uint32_t string_bucket(const ConfigBuilder *builder, const char *string, size_t length) {
+    uint32_t bucket = (uint32_t)hash_bytes(string, length) & builder->string_mask;
+    while (builder->string_keys[bucket] &&
+           strcmp(builder->strings + builder->string_keys[bucket] - 1, string) != 0)
+        bucket = (bucket + 1) & builder->string_mask;
+    return bucket;
+}
+
+uint32_t intern_string(ConfigBuilder *builder, const char *string) {
+    size_t length = strlen(string);
+    
+    // Each distinct string is stored once; the table stays at most half full
+    if (builder->string_count * 2 >= builder->string_mask) {
+        uint32_t *old_keys = builder->string_keys;
+        uint32_t old_size = old_keys ? builder->string_mask + 1 : 0;
+        builder->string_mask = old_size ? old_size * 2 - 1 : 255;
+        builder->string_keys = calloc(builder->string_mask + 1, sizeof(uint32_t));
+        if (!builder->string_keys) exit(1);
+        for (uint32_t i = 0; i < old_size; i++) {
+            if (!old_keys[i]) continue;
+            const char *key = builder->strings + old_keys[i] - 1;
+            builder->string_keys[string_bucket(builder, key, strlen(key))] = old_keys[i];
+        }
+        free(old_keys);
+    }
+    
+    uint32_t bucket = string_bucket(builder, string, length);
+    if (builder->string_keys[bucket]) return builder->string_keys[bucket] - 1;
+    
+    if (builder->strings_length + length + 1 > builder->strings_capacity) {
+        size_t capacity = builder->strings_capacity ? builder->strings_capacity * 2 : 4096;
+        while (capacity < builder->strings_length + length + 1) capacity *= 2;
+        char *strings = realloc(builder->strings, capacity);
+        if (!strings) exit(1);
+        builder->strings = strings;
+        builder->strings_capacity = capacity;
+    }
+    
+    uint32_t offset = builder->strings_length;
+    memcpy(builder->strings + offset, string, length + 1);
+    builder->strings_length += length + 1;
+    builder->string_keys[bucket] = offset + 1;
+    builder->string_count++;
+    return offset;
+}
+
+void builtin_config(ConfigBuilder *builder) {
+    const char *colors[COLOR_COUNT] = {
+        BG_COLOR, TEXT_COLOR, WINDOW_BORDER_COLOR, BORDER_COLOR, BUTTON_BG_COLOR,
+        ACTIVE_BG_COLOR, ACTIVE_TEXT_COLOR, ACTIVE_BORDER_COLOR, PRESSED_BG_COLOR,
+        PAGE_COLOR, PAGE_ACTIVE_COLOR, RUNNING_BORDER_COLOR, FAILED_BORDER_COLOR,
+        STALE_BORDER_COLOR, ICON_COLOR, ACTIVE_ICON_COLOR
+    };
+    const char *fonts[FONT_COUNT] = { ICON_FONT_NAME, TEXT_FONT_NAME, PAGE_FONT_NAME };
+    int sizes[FONT_COUNT] = { ICON_FONT_SIZE, TEXT_FONT_SIZE, PAGE_FONT_SIZE };
+    
+    memset(builder, 0, sizeof(*builder));
+    intern_string(builder, "");
+    for (int i = 0; i < COLOR_COUNT; i++) {
+        builder->colors[i] = intern_string(builder, colors[i]);
+    }
+    for (int i = 0; i < FONT_COUNT; i++) {
+        builder->fonts[i] = intern_string(builder, fonts[i]);
+        builder->font_sizes[i] = sizes[i];
+    }
+    
+    for (int page = 0; page < MAX_PAGES; page++) {
+        const struct {
+            const char *icon;
+            const char *text;
+            const char *toggle_command;
+            const char *untoggle_command;
+            int click_only;
+            const char *probe_command;
+            const char *probe_match;
+            const char *live_command;
+        } *page_config = get_page_config(page);
+        if (!page_config) continue;
+    
+        add_config_page(builder);
+        for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
+            if (!page_config[i].icon || page_config[i].icon[0] == '\0') continue;
+    
+            // Fields left out of a tuple are NULL and read as empty
+            ConfigButton *button = add_config_button(builder);
+            const char *fields[] = { page_config[i].text, page_config[i].toggle_command,
+                                     page_config[i].untoggle_command, page_config[i].probe_command,
+                                     page_config[i].probe_match, page_config[i].live_command };
+            uint32_t *offsets[] = { &button->text, &button->toggle, &button->untoggle,
+                                    &button->probe, &button->match, &button->live };
+            button->page = page;
+            button->slot = i;
+            button->icon = intern_string(builder, page_config[i].icon);
+            for (int f = 0; f < (int)(sizeof(fields) / sizeof(fields[0])); f++) {
+                *offsets[f] = intern_string(builder, fields[f] ? fields[f] : "");
+            }
+            button->click_only = page_config[i].click_only;
+        }
+    }
+}
+
+ConfigImage *finish_config(ConfigBuilder *builder, size_t *size) {
+    size_t pages_size = builder->page_count * sizeof(ConfigPage);
+    size_t buttons_size = builder->button_count * sizeof(ConfigButton);
+    *size = sizeof(ConfigImage) + pages_size + buttons_size + builder->strings_length;
+    
+    ConfigImage *config = calloc(1, *size);
+    if (!config) exit(1);
+    
+    // Buttons arrive in page order, so each page is one run found in a single pass
+    ConfigPage *pages = (ConfigPage *)(config + 1);
+    if (pages_size) memcpy(pages, builder->pages, pages_size);
+    for (uint32_t i = 0; i < builder->button_count; i++) {
+        ConfigPage *page = &pages[builder->buttons[i].page];
+        if (!page->button_count) page->first_button = i;
+        page->button_count++;
+        page->slot_count = builder->buttons[i].slot + 1;
+    }
+    for (uint32_t i = 0; i < builder->page_count; i++) {
+        place_config_buttons(&pages[i], builder->buttons + pages[i].first_button);
+        if (pages[i].columns > config->max_columns) config->max_columns = pages[i].columns;
+        if (pages[i].rows > config->max_rows) config->max_rows = pages[i].rows;
+    }
+    
+    config->magic = CONFIG_MAGIC;
+    config->version = CONFIG_VERSION;
+    config->size = *size;
+    memcpy(config->colors, builder->colors, sizeof(config->colors));
+    memcpy(config->fonts, builder->fonts, sizeof(config->fonts));
+    memcpy(config->font_sizes, builder->font_sizes, sizeof(config->font_sizes));
+    config->page_count = builder->page_count;
+    config->button_count = builder->button_count;
+    config->pages_offset = sizeof(ConfigImage);
+    config->buttons_offset = sizeof(ConfigImage) + pages_size;
+    config->strings_offset = config->buttons_offset + buttons_size;
+    if (buttons_size) memcpy((char *)config + config->buttons_offset, builder->buttons, buttons_size);
+    memcpy((char *)config + config->strings_offset, builder->strings, builder->strings_length);
+    
+    free(builder->pages);
+    free(builder->buttons);
+    free(builder->strings);
+    free(builder->string_keys);
+    builder->pages = NULL;
+    builder->buttons = NULL;
+    builder->strings = NULL;
+    builder->string_keys = NULL;
+    return config;
+}
+
+// Slots flow into the first cells they fit, row by row, and gaps hold one
+// cell each. Placing them here settles every page's grid once per config
+void place_config_buttons(ConfigPage *page, ConfigButton *buttons) {
+    uint8_t taken[MAX_PAGE_ROWS][MAX_PAGE_COLUMNS] = {{0}};
+    uint32_t next = 0, first_row = 0;
+    
+    page->rows = 0;
+    for (uint32_t slot = 0; slot < page->slot_count; slot++) {
+        ConfigButton *button = next < page->button_count && buttons[next].slot == slot ? &buttons[next++] : NULL;
+        uint32_t width = button ? button->width : 1, height = button ? button->height : 1;
+        if (width > page->columns) width = page->columns;
+        
+        uint32_t row = first_row, column = 0;
+        for (;; row++) {
+            for (column = 0; column + width <= page->columns; column++) {
+                int fits = 1;
+                for (uint32_t y = row; fits && y < row + height; y++) {
+                    for (uint32_t x = column; fits && x < column + width; x++) fits = !taken[y][x];
+                }
+                if (fits) break;
+            }
+            if (column + width <= page->columns) break;
+        }
+        
+        for (uint32_t y = row; y < row + height; y++) memset(&taken[y][column], 1, width);
+        if (row + height > page->rows) page->rows = row + height;
+        while (first_row < page->rows && !memchr(taken[first_row], 0, page->columns)) first_row++;
+        if (!button) continue;
+        
+        button->column = column;
+        button->row = row;
+        button->width = width;
+    }
+}
+
+// Values may spell characters as \uXXXX, the way config.h writes icons
+void unescape_value(const char *value, char *out, size_t size) {
+    size_t used = 0;
+    
+    while (*value && used + 4 < size) {
+        unsigned int code;
+        if (value[0] == '\\' && value[1] == 'u' && sscanf(value + 2, "%4x", &code) == 1 &&
+            strspn(value + 2, "0123456789abcdefABCDEF") >= 4) {
+            if (code == 0) {
+                break;
+            } else if (code < 0x80) {
+                out[used++] = code;
+            } else if (code < 0x800) {
+                out[used++] = 0xc0 | (code >> 6);
+                out[used++] = 0x80 | (code & 0x3f);
+            } else {
+                out[used++] = 0xe0 | (code >> 12);
+                out[used++] = 0x80 | ((code >> 6) & 0x3f);
+                out[used++] = 0x80 | (code & 0x3f);
+            }
+            value += 6;
+        } else if (value[0] == '\\' && value[1] == '\\') {
+            out[used++] = '\\';
+            value += 2;
+        } else {
+            out[used++] = *value++;
+        }
+    }
+    out[used] = '\0';
+}
+
+char *trim(char *string) {
+    while (*string == ' ' || *string == '\t') string++;
+    size_t length = strlen(string);
+    while (length && strchr(" \t\r\n", string[length - 1])) string[--length] = '\0';
+    return string;
+}
+
+int parse_config(const char *path, ConfigBuilder *builder) {
+    FILE *file = fopen(path, "re");
+    if (!file) return -1;
+    
+    // Lines, and so commands, are as long as they need to be; unescaping never
+    // grows them, it only needs a little slack for its longest sequence
+    char *line = NULL, *value = NULL;
+    size_t line_capacity = 0, value_capacity = 0;
+    ssize_t line_length;
+    int number = 0, page = -1, slot = 0, pages_seen = 0, skipping = 0;
+    ConfigButton *button = NULL;
+    
+    while ((line_length = getline(&line, &line_capacity, file)) >= 0) {
+        number++;
+        if ((size_t)line_length + 4 >= value_capacity) {
+            value_capacity = line_length + 5;
+            free(value);
+            value = malloc(value_capacity);
+            if (!value) exit(1);
+        }
+        char *text = trim(line);
+        if (!text[0] || text[0] == '#') continue;
+    
+        if (strcmp(text, "[page]") == 0) {
+            // The first page in the file replaces every built-in page
+            if (!pages_seen) {
+                builder->button_count = 0;
+                builder->page_count = 0;
+                pages_seen = 1;
+            }
+            add_config_page(builder);
+            page = builder->page_count - 1;
+            skipping = 0;
+            slot = 0;
+            button = NULL;
+            continue;
+        }
+        if (strcmp(text, "[button]") == 0) {
+            button = NULL;
+            skipping = page < 0 || slot == MAX_PAGE_BUTTONS;
+            if (page >= 0 && slot == MAX_PAGE_BUTTONS)
+                fprintf(stderr, "swgt: %s:%d: more than %d buttons on a page, ignored\n", path, number, MAX_PAGE_BUTTONS);
+            if (skipping) continue;
+            button = add_config_button(builder);
+            button->page = page;
+            button->slot = slot++;
+            continue;
+        }
+    
+        if (skipping) continue;
+        
+        char *equals = strchr(text, '=');
+        if (text[0] == '[' || !equals) {
+            fprintf(stderr, "swgt: %s:%d: expected key = value\n", path, number);
+            continue;
+        }
+        *equals = '\0';
+        char *key = trim(text);
+        unescape_value(trim(equals + 1), value, value_capacity);
+    
+        int known = 0;
+        if (button) {
+            uint32_t *fields[] = { &button->icon, &button->text, &button->toggle, &button->untoggle,
+                                   &button->probe, &button->match, &button->live };
+            for (int i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) {
+                if (strcmp(key, button_keys[i]) == 0) {
+                    *fields[i] = intern_string(builder, value);
+                    known = 1;
+                }
+            }
+            if (strcmp(key, "click") == 0) {
+                button->click_only = strcmp(value, "1") == 0 || strcmp(value, "yes") == 0 || strcmp(value, "true") == 0;
+                known = 1;
+            }
+            if (strcmp(key, "width") == 0 || strcmp(key, "height") == 0) {
+                int span = atoi(value);
+                span = span < 1 ? 1 : span > MAX_BUTTON_SPAN ? MAX_BUTTON_SPAN : span;
+                if (key[0] == 'w') button->width = span;
+                else button->height = span;
+                known = 1;
+            }
+        } else if (page >= 0 && strcmp(key, "columns") == 0) {
+            int columns = atoi(value);
+            builder->pages[page].columns = columns < 1 ? 1 : columns > MAX_PAGE_COLUMNS ? MAX_PAGE_COLUMNS : columns;
+            known = 1;
+        } else if (strncmp(key, "color.", 6) == 0) {
+            for (int i = 0; i < COLOR_COUNT; i++) {
+                if (strcmp(key + 6, color_keys[i]) == 0) {
+                    builder->colors[i] = intern_string(builder, value);
+                    known = 1;
+                }
+            }
+        } else if (strncmp(key, "font.", 5) == 0) {
+            for (int i = 0; i < FONT_COUNT; i++) {
+                size_t length = strlen(font_keys[i]);
+                if (strncmp(key + 5, font_keys[i], length) != 0) continue;
+                if (key[5 + length] == '\0') {
+                    builder->fonts[i] = intern_string(builder, value);
+                    known = 1;
+                } else if (strcmp(key + 5 + length, "_size") == 0) {
+                    builder->font_sizes[i] = atoi(value);
+                    known = 1;
+                }
+            }
+        }
+    
+        if (!known) fprintf(stderr, "swgt: %s:%d: unknown key '%s'\n", path, number, key);
+    }
+    
+    free(line);
+    free(value);
+    fclose(file);
+    return 0;
+}
+
+uint64_t hash_bytes(const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// NAME in the swgt directory under $VARIABLE, or under ~/FALLBACK
+int data_file_path(char *path, size_t size, const char *variable, const char *fallback,
+                   const char *name, int create) {
+    const char *base = getenv(variable);
+    const char *home = getenv("HOME");
+    char dir[PATH_MAX];
+    
+    if (base && base[0]) {
+        snprintf(dir, sizeof(dir), "%s", base);
+    } else if (home) {
+        snprintf(dir, sizeof(dir), "%s/%s", home, fallback);
+    } else {
+        return -1;
+    }
+    
+    if (create) mkdir(dir, 0700);
+    if ((size_t)snprintf(path, size, "%s/swgt", dir) >= size) return -1;
+    if (create) mkdir(path, 0700);
+    if ((size_t)snprintf(path, size, "%s/swgt/%s", dir, name) >= size) return -1;
+    return 0;
+}
+
+int config_cache_path(char *path, size_t size, int create) {
+    return data_file_path(path, size, "XDG_CACHE_HOME", ".cache", "config.cache", create);
+}
+
+// The cache is only trusted for the exact file it was compiled from, and
+// for the built-in defaults it was merged with
+ConfigImage *map_config_cache(const struct stat *source, uint64_t defaults_hash, size_t *size) {
+    char path[PATH_MAX];
+    if (config_cache_path(path, sizeof(path), 0) < 0) return NULL;
+    
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    
+    struct stat info;
+    ConfigImage *config = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size >= (off_t)sizeof(ConfigImage))
+        config = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (config == MAP_FAILED) return NULL;
+    
+    *size = info.st_size;
+    int valid = config->magic == CONFIG_MAGIC && config->version == CONFIG_VERSION &&
+                config->size == *size && config->defaults_hash == defaults_hash &&
+                config->source_dev == (uint64_t)source->st_dev && config->source_ino == (uint64_t)source->st_ino &&
+                config->source_size == (uint64_t)source->st_size &&
+                config->source_mtime_ns == (int64_t)source->st_mtim.tv_sec * 1000000000 + source->st_mtim.tv_nsec &&
+                config->pages_offset == sizeof(ConfigImage) &&
+                config->max_columns <= MAX_PAGE_COLUMNS && config->max_rows <= MAX_PAGE_ROWS &&
+                config->buttons_offset == config->pages_offset + (uint64_t)config->page_count * sizeof(ConfigPage) &&
+                config->strings_offset == config->buttons_offset + (uint64_t)config->button_count * sizeof(ConfigButton) &&
+                config->strings_offset < config->size && ((const char *)config)[config->size - 1] == '\0';
+    
+    // Offsets are checked once here so every later lookup can trust them
+    uint32_t strings_size = valid ? config->size - config->strings_offset : 0;
+    for (int i = 0; valid && i < COLOR_COUNT; i++) valid = config->colors[i] < strings_size;
+    for (int i = 0; valid && i < FONT_COUNT; i++) valid = config->fonts[i] < strings_size;
+    uint32_t next = 0;
+    for (uint32_t p = 0; valid && p < config->page_count; p++) {
+        const ConfigPage *page = config_page(config, p);
+        valid = page->first_button == next && page->button_count <= config->button_count - next &&
+                page->slot_count <= MAX_PAGE_BUTTONS && (page->button_count || page->slot_count == 0) &&
+                page->columns >= 1 && page->columns <= config->max_columns && page->rows <= config->max_rows;
+        for (uint32_t i = next; valid && i < next + page->button_count; i++) {
+            const ConfigButton *button = &config_buttons(config)[i];
+            valid = button->page == p && button->slot < page->slot_count &&
+                    (i == next || button[-1].slot < button->slot) &&
+                    (i + 1 < next + page->button_count || button->slot + 1 == page->slot_count) &&
+                    button->icon < strings_size && button->text < strings_size &&
+                    button->toggle < strings_size && button->untoggle < strings_size &&
+                    button->probe < strings_size && button->match < strings_size &&
+                    button->live < strings_size &&
+                    button->width >= 1 && button->column + button->width <= page->columns &&
+                    button->height >= 1 && button->row + button->height <= page->rows;
+        }
+        next += page->button_count;
+    }
+    valid = valid && next == config->button_count;
+    
+    if (!valid) {
+        munmap(config, *size);
+        return NULL;
+    }
+    return config;
+}
+
+void write_config_cache(ConfigImage *config) {
+    char path[PATH_MAX], temp[PATH_MAX + 16];
+    if (config_cache_path(path, sizeof(path), 1) < 0) return;
+    snprintf(temp, sizeof(temp), "%s.%d", path, (int)getpid());
+    
+    // Written aside and renamed, so a reader never maps a partial cache
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+    
+    int ok = write(fd, config, config->size) == (ssize_t)config->size;
+    close(fd);
+    if (!ok || rename(temp, path) < 0)
+        unlink(temp);
+}
+
+void resolve_config_path(Widget *widget) {
+    if (widget->config_path[0]) return;
+    
+    const char *base = getenv("XDG_CONFIG_HOME");
+    const char *home = getenv("HOME");
+    if (base && base[0]) {
+        snprintf(widget->config_path, sizeof(widget->config_path), "%s/swgt/config", base);
+    } else if (home) {
+        snprintf(widget->config_path, sizeof(widget->config_path), "%s/.config/swgt/config", home);
+    }
+}
+
+ConfigImage *load_config(Widget *widget, size_t *size, int *mapped) {
+    ConfigBuilder builder;
+    builtin_config(&builder);
+    
+    *mapped = 0;
+    struct stat source;
+    if (!widget->config_path[0] || stat(widget->config_path, &source) < 0)
+        return finish_config(&builder, size);
+    
+    // Hashing the defaults is cheap and keeps a rebuilt config.h from reusing old caches
+    size_t defaults_size;
+    ConfigImage *defaults = finish_config(&builder, &defaults_size);
+    uint64_t defaults_hash = hash_bytes(defaults, defaults_size);
+    free(defaults);
+    
+    ConfigImage *config = map_config_cache(&source, defaults_hash, size);
+    if (config) {
+        *mapped = 1;
+        return config;
+    }
+    
+    builtin_config(&builder);
+    parse_config(widget->config_path, &builder);
+    config = finish_config(&builder, size);
+    config->defaults_hash = defaults_hash;
+    config->source_dev = source.st_dev;
+    config->source_ino = source.st_ino;
+    config->source_size = source.st_size;
+    config->source_mtime_ns = (int64_t)source.st_mtim.tv_sec * 1000000000 + source.st_mtim.tv_nsec;
+    write_config_cache(config);
+    return config;
+}
+
+void free_config(ConfigImage *config, size_t size, int mapped) {
+    if (mapped) {
+        munmap(config, size);
+    } else {
+        free(config);
+    }
+}
+
+int config_page_equal(const ConfigImage *a, const ConfigImage *b, int page) {
+    const ConfigPage *a_page = config_page(a, page), *b_page = config_page(b, page);
+    
+    if (!a_page || !b_page) return !a_page && !b_page;
+    if (a_page->button_count != b_page->button_count || a_page->slot_count != b_page->slot_count ||
+        a_page->columns != b_page->columns) return 0;
+    
+    for (uint32_t i = 0; i < a_page->button_count; i++) {
+        const ConfigButton *x = &config_buttons(a)[a_page->first_button + i];
+        const ConfigButton *y = &config_buttons(b)[b_page->first_button + i];
+        if (x->slot != y->slot || x->click_only != y->click_only ||
+            x->width != y->width || x->height != y->height ||
+            strcmp(config_string(a, x->icon), config_string(b, y->icon)) ||
+            strcmp(config_string(a, x->text), config_string(b, y->text)) ||
+            strcmp(config_string(a, x->toggle), config_string(b, y->toggle)) ||
+            strcmp(config_string(a, x->untoggle), config_string(b, y->untoggle)) ||
+            strcmp(config_string(a, x->probe), config_string(b, y->probe)) ||
+            strcmp(config_string(a, x->match), config_string(b, y->match)) ||
+            strcmp(config_string(a, x->live), config_string(b, y->live)))
+            return 0;
+    }
+    return 1;
+}
+
+void reload_config(Widget *widget) {
+    ConfigImage *old = widget->config;
+    size_t old_size = widget->config_size;
+    int old_mapped = widget->config_mapped;
+    
+    // Filter hits are records of the old config
+    stop_filter(widget);
+    widget->config = load_config(widget, &widget->config_size, &widget->config_mapped);
+    ConfigImage *config = widget->config;
+    free_search_index(widget);
+    
+    int colors_changed = 0, fonts_changed = 0;
+    for (int i = 0; i < COLOR_COUNT; i++) {
+        colors_changed |= strcmp(config_string(old, old->colors[i]), config_string(config, config->colors[i])) != 0;
+    }
+    for (int i = 0; i < FONT_COUNT; i++) {
+        fonts_changed |= strcmp(config_string(old, old->fonts[i]), config_string(config, config->fonts[i])) != 0 ||
+                         old->font_sizes[i] != config->font_sizes[i];
+    }
+    
+    // Only what changed is rebuilt; the X connection and window stay as they are
+    int page_count = config->page_count ? config->page_count : 1;
+    int pages_changed = old->page_count != config->page_count;
+    if (widget->current_page >= page_count) set_page(widget, page_count - 1);
+    
+    // Probes and watches point into the old string table, so they are rebuilt
+    // on every reload; unchanged pages are only rebound to the new one.
+    // Pages never shown have nothing to rebuild
+    teardown_probes(widget);
+    teardown_watches(widget);
+    for (int i = 0; i < widget->live_count; i++) {
+        widget->live_labels[i].used = 0;
+    }
+    resize_pages(widget, page_count);
+    for (int page = 0; page < widget->total_pages; page++) {
+        if (config_page_equal(old, config, page)) {
+            if (widget->pages[page].loaded) bind_page_buttons(widget, page);
+            continue;
+        }
+        pages_changed = 1;
+        if (widget->pages[page].loaded) load_page_buttons(widget, page);
+    }
+    for (int page = 0; page < widget->total_pages; page++) {
+        if (widget->pages[page].loaded) attach_page_sources(widget, page);
+    }
+    
+    // Label sources the new config still names keep running; the rest are stopped
+    for (int i = 0; i < widget->live_count; i++) {
+        if (widget->live_labels[i].command && !widget->live_labels[i].used) stop_live_label(widget, i);
+    }
+    
+    if (colors_changed) {
+        release_colors(widget);
+        setup_colors(widget);
+        XSetWindowBorder(widget->display, widget->window, widget->window_border_color.pixel);
+    }
+    
+    if (fonts_changed) {
+        int fonts_loaded = widget->fonts_loaded;
+        close_fonts(widget);
+        start_font_matching(widget);
+        setup_fonts(widget);
+        if (fonts_loaded) load_deferred_fonts(widget);
+    }
+    
+    // Cached surfaces are laid out again as they are next shown
+    int width = WIDGET_WIDTH_FOR(config->max_columns ? config->max_columns : 1);
+    int height = WIDGET_HEIGHT_FOR(config->max_rows ? config->max_rows : 1);
+    if (width != widget->width || height != widget->height) {
+        resize_widget(widget, width, height);
+    } else if (pages_changed || colors_changed || fonts_changed) {
+        invalidate_page_cache(widget);
+    }
+    
+    free_config(old, old_size, old_mapped);
+}
+
+void setup_config_watch(Widget *widget) {
+    widget->config_watch_fd = -1;
+    if (!widget->config_path[0]) return;
+    
+    // Editors often replace the file, so the directory is what gets watched
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", widget->config_path);
+    char *slash = strrchr(dir, '/');
+    widget->config_name = strrchr(widget->config_path, '/') ? strrchr(widget->config_path, '/') + 1 : widget->config_path;
+    if (slash) *slash = '\0';
+    
+    widget->config_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (widget->config_watch_fd < 0) return;
+    
+    if (inotify_add_watch(widget->config_watch_fd, slash ? (dir[0] ? dir : "/") : ".",
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE | IN_MOVED_FROM) < 0 ||
+        loop_add_fd(widget, widget->config_watch_fd, EPOLLIN, handle_config_change, NULL) < 0) {
+        close(widget->config_watch_fd);
+        widget->config_watch_fd = -1;
+    }
+}
+
+void handle_config_change(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    int changed = 0;
+    
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char *cursor = buffer; cursor < buffer + n; ) {
+            struct inotify_event *event = (struct inotify_event *)cursor;
+            cursor += sizeof(*event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW || (event->len && strcmp(event->name, widget->config_name) == 0))
+                changed = 1;
+        }
+    }
+    
+    // A burst of events from one save costs a single reload
+    if (changed) reload_config(widget);
+}
+
+int control_socket_path(struct sockaddr_un *address) {
+    const char *path = getenv("SWGT_SOCKET");
+    const char *runtime = getenv("XDG_RUNTIME_DIR");
+    int written;
+    
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (path && path[0]) {
+        written = snprintf(address->sun_path, sizeof(address->sun_path), "%s", path);
+    } else if (runtime && runtime[0]) {
+        written = snprintf(address->sun_path, sizeof(address->sun_path), "%s/" CONTROL_SOCKET, runtime);
+    } else {
+        // A shared /tmp name could be bound first by another user, so the socket
+        // goes in a directory only this user can enter
+        char directory[64];
+        struct stat info;
+        snprintf(directory, sizeof(directory), "/tmp/swgt-%u", (unsigned)getuid());
+        if (mkdir(directory, 0700) < 0 && errno != EEXIST) return -1;
+        if (lstat(directory, &info) < 0 || !S_ISDIR(info.st_mode) ||
+            info.st_uid != getuid() || (info.st_mode & 077)) return -1;
+        written = snprintf(address->sun_path, sizeof(address->sun_path), "%s/" CONTROL_SOCKET, directory);
+    }
+    return written > 0 && (size_t)written < sizeof(address->sun_path) ? 0 : -1;
+}
+
+// Binds the control socket, or hands over to the instance that holds it.
+// Returns 1 once handed over; without a usable socket swgt runs on alone
+int claim_instance(Widget *widget) {
+    struct sockaddr_un address;
+    widget->control_fd = -1;
+    if (control_socket_path(&address) < 0) return 0;
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return 0;
+        if (bind(fd, (struct sockaddr *)&address, sizeof(address)) == 0 && listen(fd, 8) == 0) {
+            widget->control_fd = fd;
+            return 0;
+        }
+        int error = errno;
+        close(fd);
+        if (error != EADDRINUSE) return 0;
+        
+        // Someone answering owns the name; nobody listening leaves a stale socket.
+        // One that accepts but never answers is hung, and is not replaced
+        char *show = "show";
+        int result = control_client(1, &show);
+        if (result == 0) return 1;
+        if (result == CONTROL_NO_REPLY) exit(1);
+        unlink(address.sun_path);
+    }
+    return 0;
+}
+
+// One datagram carries the whole batch, one command per line; the reply
+// is "ok" or the errors, one per line
+int control_client(int count, char **commands) {
+    struct sockaddr_un address;
+    if (count < 1) {
+        fprintf(stderr, "usage: swgt msg COMMAND...\n");
+        return 2;
+    }
+    if (control_socket_path(&address) < 0) return 1;
+    
+    // Connecting, sending and waiting for the reply all give up after the timeout
+    struct timeval timeout = { CONTROL_TIMEOUT_MS / 1000, CONTROL_TIMEOUT_MS % 1000 * 1000 };
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        int error = errno;
+        close(fd);
+        if (error != EAGAIN && error != EWOULDBLOCK && error != EINPROGRESS) return 1;
+        fprintf(stderr, "swgt: running instance did not answer\n");
+        return CONTROL_NO_REPLY;
+    }
+    
+    size_t length = 0;
+    for (int i = 0; i < count; i++) length += strlen(commands[i]) + 1;
+    char *message = malloc(length);
+    if (!message) exit(1);
+    length = 0;
+    for (int i = 0; i < count; i++) {
+        size_t part = strlen(commands[i]);
+        memcpy(message + length, commands[i], part);
+        length += part;
+        message[length++] = '\n';
+    }
+    
+    char reply[CONTROL_REPLY_SIZE];
+    ssize_t n = -1;
+    int error = 0;
+    if (send(fd, message, length, MSG_NOSIGNAL) == (ssize_t)length) n = recv(fd, reply, sizeof(reply) - 1, 0);
+    if (n < 0) error = errno;
+    free(message);
+    close(fd);
+    if (error == EAGAIN || error == EWOULDBLOCK) {
+        fprintf(stderr, "swgt: running instance did not answer\n");
+        return CONTROL_NO_REPLY;
+    }
+    if (n <= 0) return 1;
+    
+    reply[n] = '\0';
+    if (strcmp(reply, "ok\n") == 0) return 0;
+    fputs(reply, stderr);
+    return 1;
+}
+
+void handle_control_listen(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    int client;
+    
+    while ((client = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        // SWGT_SOCKET may name a path others can reach; only this user may drive the widget
+        struct ucred peer;
+        socklen_t length = sizeof(peer);
+        if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &peer, &length) < 0 || peer.uid != getuid()) {
+            close(client);
+            continue;
+        }
+        if (loop_add_fd(widget, client, EPOLLIN, handle_control_client, NULL) < 0) close(client);
+    }
+}
+
+void handle_control_client(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    
+    // Messages are as long as their batch; peeking tells the size first
+    for (;;) {
+        ssize_t n = recv(fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) break;
+        
+        char *message = malloc(n + 1);
+        if (!message) exit(1);
+        n = recv(fd, message, n, 0);
+        if (n < 0) {
+            free(message);
+            break;
+        }
+        message[n] = '\0';
+        
+        char reply[CONTROL_REPLY_SIZE];
+        run_control_message(widget, message, reply, sizeof(reply));
+        send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+        free(message);
+    }
+    
+    loop_remove_fd(widget, fd);
+    close(fd);
+}
+
+// A button is named by "PAGE:SLOT", both counted from 1, or by its configured label
+int find_button(Widget *widget, const char *ref, int *page, int *index) {
+    const ConfigImage *config = widget->config;
+    const ConfigButton *buttons = config_buttons(config);
+    char *end;
+    
+    long number = strtol(ref, &end, 10);
+    if (end != ref && *end == ':') {
+        long slot = strtol(end + 1, &end, 10);
+        if (*end || number < 1 || number > widget->total_pages) return -1;
+        *page = number - 1;
+        *index = slot - 1;
+        load_page(widget, *page);
+        if (*index < 0 || *index >= widget->pages[*page].button_count) return -1;
+        return widget->pages[*page].buttons[*index].present ? 0 : -1;
+    }
+    
+    for (uint32_t i = 0; i < config->button_count; i++) {
+        if (strcmp(config_string(config, buttons[i].text), ref) != 0) continue;
+        *page = buttons[i].page;
+        *index = buttons[i].slot;
+        load_page(widget, *page);
+        return 0;
+    }
+    return -1;
+}
+
+// Commands only mark damage, so a whole message costs a single redraw
+void run_control_message(Widget *widget, char *message, char *reply, size_t size) {
+    size_t used = 0;
+    int number = 0;
+    reply[0] = '\0';
+    
+    for (char *line = strtok(message, "\n"); line; line = strtok(NULL, "\n")) {
+        number++;
+        char *command = line + strspn(line, " \t");
+        char *args = command + strcspn(command, " \t");
+        if (*args) *args++ = '\0';
+        args += strspn(args, " \t");
+        if (!command[0]) continue;
+        
+        // Commands naming a button take it first; a label is the rest of the line
+        char *ref = args;
+        char *rest = ref + strcspn(ref, " \t");
+        if (*rest) *rest++ = '\0';
+        rest += strspn(rest, " \t");
+        int page = -1, index = -1;
+        const char *error = NULL;
+        
+        if (strcmp(command, "show") == 0) {
+            widget->pinned = 1;
+            start_show_animation(widget);
+        } else if (strcmp(command, "hide") == 0) {
+            widget->pinned = 0;
+            start_close_animation(widget);
+        } else if (strcmp(command, "page") == 0) {
+            int target = atoi(ref);
+            if (target < 1 || target > widget->total_pages) error = "no such page";
+            else set_page(widget, target - 1);
+        } else if (strcmp(command, "active") == 0 || strcmp(command, "label") == 0 ||
+                   strcmp(command, "run") == 0 || strcmp(command, "timer") == 0) {
+            if (find_button(widget, ref, &page, &index) < 0) {
+                error = "no such button";
+            } else if (command[0] == 'a') {
+                Button *button = &widget->pages[page].buttons[index];
+                if (strcmp(rest, "0") != 0 && strcmp(rest, "1") != 0) {
+                    error = "expected 0 or 1";
+                } else {
+                    button->is_active = rest[0] == '1';
+                    damage_page(widget, page, DAMAGE_BUTTON(index));
+                }
+            } else if (command[0] == 't') {
+                // Without a time the button's own step is added; 0 stops the countdown.
+                // Other buttons are left alone, since an ending countdown clears their state
+                int step = widget->pages[page].commands[index].timer_step;
+                if (!step) error = "not a timer";
+                else add_timer_time(widget, page, index, rest[0] ? atoi(rest) : step);
+            } else if (command[0] == 'l') {
+                ButtonCommands *commands = &widget->pages[page].commands[index];
+                free(commands->label);
+                commands->label = rest[0] ? strdup(rest) : NULL;
+                relayout_button(widget, page, index);
+            } else {
+                toggle_button(widget, page, index);
+            }
+        } else {
+            error = "unknown command";
+        }
+        
+        if (error && used < size) used += snprintf(reply + used, size - used, "%d: %s\n", number, error);
+    }
+    
+    if (!used) snprintf(reply, size, "ok\n");
+}
+
+void print_config(const ConfigImage *config) {
+    for (int i = 0; i < COLOR_COUNT; i++) {
+        printf("color.%s = %s\n", color_keys[i], config_string(config, config->colors[i]));
+    }
+    for (int i = 0; i < FONT_COUNT; i++) {
+        printf("font.%s = %s\nfont.%s_size = %d\n", font_keys[i], config_string(config, config->fonts[i]),
+               font_keys[i], config->font_sizes[i]);
+    }
+    
+    const ConfigButton *buttons = config_buttons(config);
+    for (uint32_t page = 0; page < config->page_count; page++) {
+        const ConfigPage *run = config_page(config, page);
+        uint32_t next = run->first_button;
+        printf("\n[page]\n");
+        if (run->columns != 1) printf("columns = %u\n", run->columns);
+        
+        // Later slots keep their position only if the gaps are written out
+        for (uint32_t slot = 0; slot < run->slot_count; slot++) {
+            printf("[button]\n");
+            if (buttons[next].slot != slot) continue;
+    
+            const ConfigButton *button = &buttons[next++];
+            uint32_t fields[] = { button->icon, button->text, button->toggle, button->untoggle,
+                                  button->probe, button->match, button->live };
+            for (int i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) {
+                const char *value = config_string(config, fields[i]);
+                if (!value[0]) continue;
+    
+                // Non-ASCII is escaped so icons survive editors without the icon font
+                printf("%s = ", button_keys[i]);
+                while (*value) {
+                    FcChar32 code;
+                    int used = FcUtf8ToUcs4((const FcChar8 *)value, &code, strlen(value));
+                    if (used <= 0) break;
+                    if (code < 0x80 || code > 0xffff) fwrite(value, 1, used, stdout);
+                    else printf("\\u%04x", (unsigned)code);
+                    value += used;
+                }
+                putchar('\n');
+            }
+            if (button->click_only) printf("click = 1\n");
+            if (button->width != 1) printf("width = %u\n", button->width);
+            if (button->height != 1) printf("height = %u\n", button->height);
+        }
+    }
+}
+
+const ConfigButton *button_entry(Widget *widget, int page, int index) {
+    resolve_slot(widget, &page, &index);
+    uint32_t entry = widget->pages[page].commands[index].entry;
+    return entry == NO_ENTRY ? NULL : &config_buttons(widget->config)[entry];
+}
+
+void free_page_buttons(Widget *widget, int page) {
+    Page *slots = &widget->pages[page];
+    
+    for (int i = 0; i < slots->button_count; i++) {
+        free(slots->commands[i].toggle);
+        free(slots->commands[i].untoggle);
+        free(slots->commands[i].label);
+    }
+    free(slots->buttons);
+    free(slots->commands);
+    free(slots->rects);
+    free(slots->hit_map);
+    memset(slots, 0, sizeof(*slots));
+}
+
+// Points every slot at its record in the current config. A reload that
+// leaves the page as it was needs nothing more, so its state survives
+void bind_page_buttons(Widget *widget, int page) {
+    const ConfigImage *config = widget->config;
+    const ConfigPage *run = config_page(config, page);
+    Page *slots = &widget->pages[page];
+    
+    for (int i = 0; i < slots->button_count; i++) {
+        slots->commands[i].entry = NO_ENTRY;
+    }
+    for (uint32_t i = 0; run && i < run->button_count; i++) {
+        const ConfigButton *entry = &config_buttons(config)[run->first_button + i];
+        if ((int)entry->slot < slots->button_count)
+            slots->commands[entry->slot].entry = run->first_button + i;
+    }
+}
+
+void load_page_buttons(Widget *widget, int page) {
+    const ConfigImage *config = widget->config;
+    const ConfigPage *run = config_page(config, page);
+    Page *slots = &widget->pages[page];
+    
+    free_page_buttons(widget, page);
+    slots->loaded = 1;
+    
+    // Slots up to the last configured one; a page without buttons allocates nothing
+    int count = run ? run->slot_count : 0;
+    if (count == 0) return;
+    
+    slots->buttons = calloc(count, sizeof(Button));
+    slots->commands = calloc(count, sizeof(ButtonCommands));
+    slots->rects = calloc(count, sizeof(XRectangle));
+    slots->hit_map = malloc(run->columns * run->rows);
+    if (!slots->buttons || !slots->commands || !slots->rects || !slots->hit_map) exit(1);
+    slots->button_count = count;
+    slots->columns = run->columns;
+    slots->rows = run->rows;
+    memset(slots->hit_map, NO_HIT, run->columns * run->rows);
+    bind_page_buttons(widget, page);
+    
+    // Tokenize and resolve every command once instead of on each click
+    for (int i = 0; i < count; i++) {
+        const ConfigButton *entry = button_entry(widget, page, i);
+        ButtonCommands *commands = &slots->commands[i];
+        commands->probe = commands->watch = commands->live = commands->work = -1;
+        if (!entry) continue;
+        
+        // Cells become pixels once; drawing and hit testing both read the result
+        XRectangle *rect = &slots->rects[i];
+        rect->x = WIDGET_PADDING + entry->column * (BUTTON_SIZE + BUTTON_MARGIN);
+        rect->y = WIDGET_PADDING + entry->row * (BUTTON_SIZE + BUTTON_MARGIN);
+        rect->width = entry->width * BUTTON_SIZE + (entry->width - 1) * BUTTON_MARGIN;
+        rect->height = entry->height * BUTTON_SIZE + (entry->height - 1) * BUTTON_MARGIN;
+        for (int row = entry->row; row < entry->row + entry->height; row++) {
+            memset(&slots->hit_map[row * slots->columns + entry->column], i, entry->width);
+        }
+        
+        slots->buttons[i].present = config_string(config, entry->icon)[0] != '\0';
+        slots->buttons[i].click_only = entry->click_only;
+        const char *toggle = config_string(config, entry->toggle);
+        commands->timer_step = timer_spec_seconds(toggle);
+        commands->work = strncmp(toggle, "work:", 5) == 0 ? atoi(toggle + 5) : -1;
+        if (commands->work >= 0) {
+            // The ledger opens with the first work button shown
+            if (widget->work.fd < 0 && open_work_ledger(&widget->work, 1) == 0) {
+                format_work_time(widget->work.label, sizeof(widget->work.label),
+                                 work_day_total(&widget->work, work_day(time(NULL))));
+            }
+            slots->buttons[i].is_active = widget->work.session != 0;
+            continue;
+        }
+        if (!commands->timer_step) commands->toggle = compile_command(toggle);
+        commands->untoggle = compile_command(config_string(config, entry->untoggle));
+    }
+}
+
+void attach_page_sources(Widget *widget, int page) {
+    Page *slots = &widget->pages[page];
+    
+    for (int i = 0; i < slots->button_count; i++) {
+        const ConfigButton *entry = button_entry(widget, page, i);
+        ButtonCommands *commands = &slots->commands[i];
+        commands->probe = commands->watch = commands->live = -1;
+        slots->buttons[i].stale = 0;
+        if (!entry) continue;
+        
+        const char *live = config_string(widget->config, entry->live);
+        if (live[0]) commands->live = add_live_label(widget, live);
+        if (slots->buttons[i].click_only) continue;
+        
+        const char *spec = config_string(widget->config, entry->probe);
+        if (!spec[0]) continue;
+        
+        if (is_watch_spec(spec)) {
+            commands->watch = add_watch(widget, spec);
+            if (commands->watch >= 0) apply_watch(widget, commands->watch);
+            continue;
+        }
+        
+        // A result already in hand is shown at once; a run in flight will update it
+        commands->probe = add_probe(widget, spec);
+        Probe *probe = &widget->probes[commands->probe];
+        if (probe->pid) {
+            slots->buttons[i].stale = 1;
+        } else if (probe->has_result) {
+            apply_probe(widget, commands->probe);
+        }
+    }
+    
+    // A page first reached while shown is probed now rather than on the next show
+    if (widget->is_visible || widget->is_animating) refresh_probes(widget);
+}
+
+// Pages cost nothing until they are first shown or prerendered
+void load_page(Widget *widget, int page) {
+    if (widget->pages[page].loaded) return;
+    
+    load_page_buttons(widget, page);
+    attach_page_sources(widget, page);
+}
+
+void resize_pages(Widget *widget, int count) {
+    for (int page = count; page < widget->total_pages; page++) {
+        free_page_buttons(widget, page);
+    }
+    
+    Page *pages = realloc(widget->pages, count * sizeof(Page));
+    if (!pages && count) exit(1);
+    if (count > widget->total_pages)
+        memset(pages + widget->total_pages, 0, (count - widget->total_pages) * sizeof(Page));
+    widget->pages = pages;
+    widget->total_pages = count;
+}
+
+// The page on screen: the filter results while filtering, else the current page
+int shown_page(Widget *widget) {
+    return widget->filter.active ? FILTER_PAGE : widget->current_page;
+}
+
+Page *page_slots(Widget *widget, int page) {
+    return page == FILTER_PAGE ? &widget->filter.view : &widget->pages[page];
+}
+
+// Turns a slot of the filter results into the page and slot of its button
+void resolve_slot(Widget *widget, int *page, int *index) {
+    if (*page != FILTER_PAGE) return;
+    
+    const ConfigButton *entry = &config_buttons(widget->config)[widget->filter.shown[*index]];
+    *page = entry->page;
+    *index = entry->slot;
+}
+
+uint32_t search_key(const char *gram, int length) {
+    uint32_t key = (uint32_t)length << 24;
+    for (int i = 0; i < length; i++) {
+        key |= (uint32_t)(unsigned char)tolower((unsigned char)gram[i]) << (8 * i);
+    }
+    return key;
+}
+
+uint32_t search_bucket(const SearchIndex *index, uint32_t key) {
+    uint32_t bucket = (key * 2654435761u) & index->mask;
+    while (index->keys[bucket] && index->keys[bucket] != key) bucket = (bucket + 1) & index->mask;
+    return bucket;
+}
+
+int is_searchable(Widget *widget, const ConfigButton *entry) {
+    return config_string(widget->config, entry->icon)[0] && config_string(widget->config, entry->text)[0];
+}
+
+void build_search_index(Widget *widget) {
+    SearchIndex *index = &widget->search;
+    const ConfigImage *config = widget->config;
+    const ConfigButton *buttons = config_buttons(config);
+    
+    // At most three grams start at each byte; keep the table under half full
+    size_t grams = 0;
+    for (uint32_t r = 0; r < config->button_count; r++) {
+        if (is_searchable(widget, &buttons[r])) grams += 3 * strlen(config_string(config, buttons[r].text));
+    }
+    uint32_t bucket_count = 16;
+    while (bucket_count < grams * 2) bucket_count *= 2;
+    
+    index->mask = bucket_count - 1;
+    index->keys = calloc(bucket_count, sizeof(uint32_t));
+    index->counts = calloc(bucket_count, sizeof(uint32_t));
+    index->starts = calloc(bucket_count, sizeof(uint32_t));
+    if (!index->keys || !index->counts || !index->starts) exit(1);
+    
+    // Counted on the first pass and filled on the second; records arrive in
+    // order, so a label repeating a gram is caught by the bucket's last entry
+    uint32_t *last = index->starts, total = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t r = 0; r < config->button_count; r++) {
+            if (!is_searchable(widget, &buttons[r])) continue;
+            
+            const char *label = config_string(config, buttons[r].text);
+            size_t length = strlen(label);
+            for (size_t i = 0; i < length; i++) {
+                for (int n = 1; n <= 3 && i + n <= length; n++) {
+                    uint32_t key = search_key(label + i, n);
+                    uint32_t bucket = search_bucket(index, key);
+                    index->keys[bucket] = key;
+                    if (pass == 0) {
+                        if (last[bucket] == r + 1) continue;
+                        last[bucket] = r + 1;
+                        index->counts[bucket]++;
+                        total++;
+                    } else {
+                        uint32_t *end = &last[bucket];
+                        if (*end > index->starts[bucket] && index->postings[*end - 1] == r) continue;
+                        index->postings[(*end)++] = r;
+                    }
+                }
+            }
+        }
+        if (pass) break;
+        
+        index->postings = malloc((total ? total : 1) * sizeof(uint32_t));
+        last = malloc(bucket_count * sizeof(uint32_t));
+        if (!index->postings || !last) exit(1);
+        for (uint32_t i = 0, next = 0; i < bucket_count; i++) {
+            index->starts[i] = last[i] = next;
+            next += index->counts[i];
+        }
+    }
+    free(last);
+}
+
+void free_search_index(Widget *widget) {
+    free(widget->search.keys);
+    free(widget->search.starts);
+    free(widget->search.counts);
+    free(widget->search.postings);
+    memset(&widget->search, 0, sizeof(widget->search));
+}
+
+const uint32_t *search_postings(Widget *widget, const char *gram, int length, uint32_t *count) {
+    const SearchIndex *index = &widget->search;
+    uint32_t bucket = search_bucket(index, search_key(gram, length));
+    *count = index->keys[bucket] ? index->counts[bucket] : 0;
+    return index->postings + index->starts[bucket];
+}
+
+void start_filter(Widget *widget) {
+    Filter *filter = &widget->filter;
+    const ConfigImage *config = widget->config;
+    if (filter->active) return;
+    
+    // The index is built on the first filter after each config load
+    if (!widget->search.keys) build_search_index(widget);
+    
+    // Hits fill the widget's grid one cell each, laid out once per filter
+    int columns = config->max_columns ? config->max_columns : 1;
+    int rows = config->max_rows ? config->max_rows : 1;
+    int capacity = columns * rows < MAX_PAGE_BUTTONS ? columns * rows : MAX_PAGE_BUTTONS;
+    Page *view = &filter->view;
+    memset(view, 0, sizeof(*view));
+    view->loaded = 1;
+    view->columns = columns;
+    view->rows = rows;
+    view->rects = calloc(capacity, sizeof(XRectangle));
+    view->hit_map = malloc(columns * rows);
+    filter->shown = calloc(capacity, sizeof(uint32_t));
+    if (!view->rects || !view->hit_map || !filter->shown) exit(1);
+    memset(view->hit_map, NO_HIT, columns * rows);
+    for (int i = 0; i < capacity; i++) {
+        view->rects[i].x = WIDGET_PADDING + (i % columns) * (BUTTON_SIZE + BUTTON_MARGIN);
+        view->rects[i].y = WIDGET_PADDING + (i / columns) * (BUTTON_SIZE + BUTTON_MARGIN);
+        view->rects[i].width = view->rects[i].height = BUTTON_SIZE;
+    }
+    
+    filter->capacity = capacity;
+    filter->length = 0;
+    filter->query[0] = '\0';
+    filter->active = 1;
+    update_filter_view(widget);
+}
+
+void stop_filter(Widget *widget) {
+    Filter *filter = &widget->filter;
+    if (!filter->active) return;
+    
+    for (int i = 1; i <= filter->length; i++) {
+        free(filter->hits[i]);
+    }
+    free(filter->view.rects);
+    free(filter->view.hit_map);
+    free(filter->shown);
+    memset(filter, 0, sizeof(*filter));
+    widget->needs_redraw = 1;
+}
+
+void type_filter_char(Widget *widget, char c) {
+    Filter *filter = &widget->filter;
+    if (filter->length == MAX_QUERY_LENGTH) return;
+    
+    filter->query[filter->length++] = tolower((unsigned char)c);
+    filter->query[filter->length] = '\0';
+    
+    // Only the gram ending at the new character is looked up and intersected
+    // with the previous hits. Up to three characters the query is that gram
+    // and matches exactly; longer ones are confirmed against the label
+    int length = filter->length, n = length < 3 ? length : 3;
+    uint32_t count;
+    const uint32_t *postings = search_postings(widget, filter->query + length - n, n, &count);
+    const uint32_t *previous = filter->hits[length - 1];
+    uint32_t previous_count = length > 1 ? filter->hit_counts[length - 1] : count;
+    
+    uint32_t *hits = malloc((count < previous_count ? count : previous_count) * sizeof(uint32_t) + 1);
+    if (!hits) exit(1);
+    uint32_t found = 0;
+    if (length == 1) {
+        memcpy(hits, postings, count * sizeof(uint32_t));
+        found = count;
+    } else {
+        for (uint32_t i = 0, j = 0; i < previous_count && j < count;) {
+            if (previous[i] < postings[j]) {
+                i++;
+            } else if (previous[i] > postings[j]) {
+                j++;
+            } else {
+                const char *label = config_string(widget->config, config_buttons(widget->config)[previous[i]].text);
+                if (length <= 3 || strcasestr(label, filter->query)) hits[found++] = previous[i];
+                i++;
+                j++;
+            }
+        }
+    }
+    
+    filter->hits[length] = hits;
+    filter->hit_counts[length] = found;
+    update_filter_view(widget);
+}
+
+void erase_filter_char(Widget *widget) {
+    Filter *filter = &widget->filter;
+    if (filter->length == 0) {
+        stop_filter(widget);
+        if (widget->timer_count) update_countdowns(widget);
+        return;
+    }
+    
+    free(filter->hits[filter->length]);
+    filter->hits[filter->length] = NULL;
+    filter->query[--filter->length] = '\0';
+    update_filter_view(widget);
+}
+
+void update_filter_view(Widget *widget) {
+    Filter *filter = &widget->filter;
+    const uint32_t *hits = filter->hits[filter->length];
+    uint32_t count = filter->length ? filter->hit_counts[filter->length] : 0;
+    int shown = 0;
+    
+    // Labels starting with the query come first, each group in page order
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < count && shown < filter->capacity; i++) {
+            const char *label = config_string(widget->config, config_buttons(widget->config)[hits[i]].text);
+            int prefix = strncasecmp(label, filter->query, filter->length) == 0;
+            if (prefix == !pass) filter->shown[shown++] = hits[i];
+        }
+    }
+    
+    // Only pages with a button on show are loaded
+    for (int i = 0; i < shown; i++) {
+        load_page(widget, config_buttons(widget->config)[filter->shown[i]].page);
+    }
+    filter->view.button_count = shown;
+    if (widget->timer_count) update_countdowns(widget);
+    
+    // Cells past the last hit hold nothing to click
+    for (int i = 0; i < filter->capacity; i++) {
+        filter->view.hit_map[i] = i < shown ? i : NO_HIT;
+    }
+    
+    // The results surface is laid out again from scratch
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        if (widget->page_cache[i].page == FILTER_PAGE) widget->page_cache[i].page = -1;
+    }
+    widget->needs_redraw = 1;
+}
+
+void handle_filter_key(Widget *widget, XKeyEvent *key) {
+    char text[8];
+    KeySym keysym;
+    int length = XLookupString(key, text, sizeof(text), &keysym, NULL);
+    
+    switch (keysym) {
+        case XK_Escape:
+            stop_filter(widget);
+            if (widget->timer_count) update_countdowns(widget);
+            return;
+        case XK_BackSpace:
+            erase_filter_char(widget);
+            return;
+        case XK_Return:
+        case XK_KP_Enter:
+            // Runs the top hit and leaves the results up to show its new state
+            if (widget->filter.view.button_count > 0) {
+                int page = FILTER_PAGE, index = 0;
+                resolve_slot(widget, &page, &index);
+                toggle_button(widget, page, index);
+            }
+            return;
+    }
+    
+    if (length == 1 && (unsigned char)text[0] >= 0x20 && text[0] != 0x7f) {
+        type_filter_char(widget, text[0]);
+    }
+}
+
+void init_buttons(Widget *widget) {
+    widget->pages = NULL;
+    widget->total_pages = 0;
+    widget->probes = NULL;
+    widget->probe_count = widget->probe_capacity = 0;
+    widget->live_labels = NULL;
+    widget->live_count = widget->live_capacity = 0;
+    memset(&widget->render_list, 0, sizeof(widget->render_list));
+    widget->live_flushed_us = 0;
+    widget->timer_notify = compile_command(TIMER_NOTIFY_COMMAND);
+    widget->timers = NULL;
+    widget->timer_count = widget->timer_capacity = 0;
+    widget->work_notify = compile_command(WORK_NOTIFY_COMMAND);
+    memset(&widget->work, 0, sizeof(widget->work));
+    widget->work.fd = widget->work.index_fd = -1;
+    widget->watches = NULL;
+    widget->watch_count = widget->watch_capacity = 0;
+    widget->rfkill_fd = widget->inotify_fd = widget->netlink_fd = -1;
+    widget->rfkill_device_count = 0;
+    
+    // Only the page index is sized here; buttons are loaded page by page
+    const ConfigImage *config = widget->config;
+    resize_pages(widget, config->page_count ? config->page_count : 1);
+    widget->current_page = DEFAULT_PAGE < widget->total_pages ? DEFAULT_PAGE : 0;
+    widget->width = WIDGET_WIDTH_FOR(config->max_columns ? config->max_columns : 1);
+    widget->height = WIDGET_HEIGHT_FOR(config->max_rows ? config->max_rows : 1);
+    memset(&widget->filter, 0, sizeof(widget->filter));
+    memset(&widget->search, 0, sizeof(widget->search));
+}
+
+XColor parse_color(Widget *widget, const char *color_str) {
+    XColor color;
+    if (!XParseColor(widget->display, widget->colormap, color_str, &color) ||
+        !XAllocColor(widget->display, widget->colormap, &color)) {
+        color.red = color.green = color.blue = 65535;
+        XAllocColor(widget->display, widget->colormap, &color);
+    }
+    return color;
+}
+
+void setup_colors(Widget *widget) {
+    int screen = DefaultScreen(widget->display);
+    widget->colormap = DefaultColormap(widget->display, screen);
+    widget->visual = DefaultVisual(widget->display, screen);
+    
+    const char *specs[COLOR_ICON];
+    for (int i = 0; i < COLOR_ICON; i++) {
+        specs[i] = config_string(widget->config, widget->config->colors[i]);
+    }
+    XColor *colors[COLOR_ICON] = {
+        &widget->bg_color, &widget->text_color, &widget->window_border_color, &widget->border_color,
+        &widget->button_bg_color, &widget->active_bg_color, &widget->active_text_color,
+        &widget->active_border_color, &widget->pressed_bg_color, &widget->page_color,
+        &widget->page_active_color, &widget->running_border_color, &widget->failed_border_color,
+        &widget->stale_border_color
+    };
+    int count = sizeof(specs) / sizeof(specs[0]);
+    
+    // TrueColor pixels follow from the visual's masks, no server round trips needed
+    widget->colors_allocated = 0;
+    if (widget->visual->class == TrueColor) {
+        for (int i = 0; i < count; i++) {
+            if (!XParseColor(widget->display, widget->colormap, specs[i], colors[i])) {
+                colors[i]->red = colors[i]->green = colors[i]->blue = 65535;
+            }
+            compute_truecolor_pixel(widget, colors[i]);
+        }
+    } else {
+        widget->colors_allocated = 1;
+#ifdef USE_XCB
+        // Send every allocation before reading any reply: one round trip instead of one per colour
+        xcb_alloc_color_cookie_t cookies[sizeof(specs) / sizeof(specs[0])];
+        for (int i = 0; i < count; i++) {
+            if (!XParseColor(widget->display, widget->colormap, specs[i], colors[i])) {
+                colors[i]->red = colors[i]->green = colors[i]->blue = 65535;
+            }
+            cookies[i] = xcb_alloc_color(widget->xcb, widget->colormap,
+                                         colors[i]->red, colors[i]->green, colors[i]->blue);
+        }
+        for (int i = 0; i < count; i++) {
+            xcb_alloc_color_reply_t *reply = xcb_alloc_color_reply(widget->xcb, cookies[i], NULL);
+            if (reply) {
+                colors[i]->pixel = reply->pixel;
+                colors[i]->red = reply->red;
+                colors[i]->green = reply->green;
+                colors[i]->blue = reply->blue;
+                free(reply);
+            } else {
+                colors[i]->pixel = WhitePixel(widget->display, screen);
+            }
+        }
+#else
+        for (int i = 0; i < count; i++) {
+            *colors[i] = parse_color(widget, specs[i]);
+        }
+#endif
+    }
+    
+    int xft_specs[] = { COLOR_TEXT, COLOR_ACTIVE_TEXT, COLOR_ICON, COLOR_ACTIVE_ICON, COLOR_PAGE, COLOR_PAGE_ACTIVE };
+    XftColor *xft_colors[] = {
+        &widget->xft_text_color, &widget->xft_active_text_color, &widget->xft_icon_color,
+        &widget->xft_active_icon_color, &widget->xft_page_color, &widget->xft_page_active_color
+    };
+    for (int i = 0; i < (int)(sizeof(xft_colors) / sizeof(xft_colors[0])); i++) {
+        XftColorAllocName(widget->display, widget->visual, widget->colormap,
+                          config_string(widget->config, widget->config->colors[xft_specs[i]]), xft_colors[i]);
+    }
+}
+
+void release_colors(Widget *widget) {
+    XftColor *xft_colors[] = {
+        &widget->xft_text_color, &widget->xft_active_text_color, &widget->xft_icon_color,
+        &widget->xft_active_icon_color, &widget->xft_page_color, &widget->xft_page_active_color
+    };
+    for (int i = 0; i < (int)(sizeof(xft_colors) / sizeof(xft_colors[0])); i++) {
+        XftColorFree(widget->display, widget->visual, widget->colormap, xft_colors[i]);
+    }
+    
+    unsigned long pixels[] = {
+        widget->bg_color.pixel, widget->text_color.pixel, widget->window_border_color.pixel, widget->border_color.pixel,
+        widget->button_bg_color.pixel, widget->active_bg_color.pixel, 
+        widget->active_text_color.pixel, widget->active_border_color.pixel,
+        widget->pressed_bg_color.pixel, widget->page_color.pixel, widget->page_active_color.pixel,
+        widget->running_border_color.pixel, widget->failed_border_color.pixel,
+        widget->stale_border_color.pixel
+    };
+    if (widget->colors_allocated)
+        XFreeColors(widget->display, widget->colormap, pixels, sizeof(pixels) / sizeof(pixels[0]), 0);
+}
+
+void compute_truecolor_pixel(Widget *widget, XColor *color) {
+    unsigned long masks[] = { widget->visual->red_mask, widget->visual->green_mask, widget->visual->blue_mask };
+    unsigned short values[] = { color->red, color->green, color->blue };
+    
+    color->pixel = 0;
+    for (int i = 0; i < 3; i++) {
+        unsigned long mask = masks[i];
+        int shift = 0, bits = 0;
+        while (mask && !(mask & 1)) { mask >>= 1; shift++; }
+        while (mask & 1) { mask >>= 1; bits++; }
+        color->pixel |= ((unsigned long)values[i] >> (16 - bits)) << shift;
+    }
+}
+
+void *match_fonts_worker(void *data) {
+    FontMatchJob *job = data;
+    
+    // Same steps as XftFontMatch; the first call pays for loading the fontconfig cache
+    for (int i = 0; i < FONT_COUNT; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "%s:size=%d", job->names[i], job->sizes[i]);
+        
+        job->matches[i] = NULL;
+        FcPattern *pattern = FcNameParse((FcChar8 *)name);
+        if (!pattern) continue;
         
-        if (page_config) {
-            for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
-                if (page_config[i].icon[0] != '\0') {
-                    strcpy(widget->buttons[page][i].icon, page_config[i].icon);
-                    strcpy(widget->buttons[page][i].text, page_config[i].text);
-                    strcpy(widget->buttons[page][i].toggle_command, page_config[i].toggle_command);
-                    strcpy(widget->buttons[page][i].untoggle_command, page_config[i].untoggle_command);
-                    widget->buttons[page][i].click_only = page_config[i].click_only;
-                }
-            }
-        }
+        FcResult result;
+        FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+        XftDefaultSubstitute(job->display, job->screen, pattern);
+        job->matches[i] = FcFontMatch(NULL, pattern, &result);
+        FcPatternDestroy(pattern);
     }
-    
-    widget->current_page = DEFAULT_PAGE;
-    widget->total_pages = MAX_PAGES;
+    return NULL;
 }
 
-XColor parse_color(Widget *widget, const char *color_str) {
-    XColor color;
-    if (!XParseColor(widget->display, widget->colormap, color_str, &color) ||
-        !XAllocColor(widget->display, widget->colormap, &color)) {
-        color.red = color.green = color.blue = 65535;
-        XAllocColor(widget->display, widget->colormap, &color);
+void start_font_matching(Widget *widget) {
+    FontMatchJob *job = &widget->font_job;
+    job->display = widget->display;
+    job->screen = DefaultScreen(widget->display);
+    for (int i = 0; i < FONT_COUNT; i++) {
+        job->names[i] = config_string(widget->config, widget->config->fonts[i]);
+        job->sizes[i] = widget->config->font_sizes[i];
+    }
+    
+    // Initialize Xft's per-display info here so the worker only reads it
+    XftDefaultHasRender(widget->display);
+    
+    if (pthread_create(&job->thread, NULL, match_fonts_worker, job) != 0) {
+        match_fonts_worker(job);
+        job->thread = 0;
     }
-    return color;
 }
 
-void setup_colors(Widget *widget) {
-    int screen = DefaultScreen(widget->display);
-    widget->colormap = DefaultColormap(widget->display, screen);
-    widget->visual = DefaultVisual(widget->display, screen);
-    
-    widget->bg_color = parse_color(widget, BG_COLOR);
-    widget->text_color = parse_color(widget, TEXT_COLOR);
-    widget->window_border_color = parse_color(widget, WINDOW_BORDER_COLOR);
-    widget->border_color = parse_color(widget, BORDER_COLOR);
-    widget->button_bg_color = parse_color(widget, BUTTON_BG_COLOR);
-    widget->active_bg_color = parse_color(widget, ACTIVE_BG_COLOR);
-    widget->active_text_color = parse_color(widget, ACTIVE_TEXT_COLOR);
-    widget->active_border_color = parse_color(widget, ACTIVE_BORDER_COLOR);
-    widget->pressed_bg_color = parse_color(widget, PRESSED_BG_COLOR);
-    widget->page_color = parse_color(widget, PAGE_COLOR);
-    widget->page_active_color = parse_color(widget, PAGE_ACTIVE_COLOR);
-    
-    XftColorAllocName(widget->display, widget->visual, widget->colormap, TEXT_COLOR, &widget->xft_text_color);
-    XftColorAllocName(widget->display, widget->visual, widget->colormap, ACTIVE_TEXT_COLOR, &widget->xft_active_text_color);
-    XftColorAllocName(widget->display, widget->visual, widget->colormap, ICON_COLOR, &widget->xft_icon_color);
-    XftColorAllocName(widget->display, widget->visual, widget->colormap, ACTIVE_ICON_COLOR, &widget->xft_active_icon_color);
-    XftColorAllocName(widget->display, widget->visual, widget->colormap, PAGE_COLOR, &widget->xft_page_color);
-    XftColorAllocName(widget->display, widget->visual, widget->colormap, PAGE_ACTIVE_COLOR, &widget->xft_page_active_color);
+XftFont *open_matched_font(Widget *widget, FcPattern *match, const char *fallback) {
+    XftFont *font = match ? XftFontOpenPattern(widget->display, match) : NULL;
+    if (!font) {
+        if (match) FcPatternDestroy(match);
+        font = XftFontOpenName(widget->display, DefaultScreen(widget->display), fallback);
+    }
+    return font;
 }
 
 void setup_fonts(Widget *widget) {
-    char icon_pattern[256], text_pattern[256], page_pattern[256];
-    
-    snprintf(icon_pattern, sizeof(icon_pattern), "%s:size=%d", ICON_FONT_NAME, ICON_FONT_SIZE);
-    snprintf(text_pattern, sizeof(text_pattern), "%s:size=%d", TEXT_FONT_NAME, TEXT_FONT_SIZE);
-    snprintf(page_pattern, sizeof(page_pattern), "%s:size=%d", PAGE_FONT_NAME, PAGE_FONT_SIZE);
+    FontMatchJob *job = &widget->font_job;
+    if (job->thread) {
+        pthread_join(job->thread, NULL);
+        job->thread = 0;
+    }
     
-    widget->icon_font = XftFontOpenName(widget->display, DefaultScreen(widget->display), icon_pattern);
-    if (!widget->icon_font)
-        widget->icon_font = XftFontOpenName(widget->display, DefaultScreen(widget->display), "monospace:size=20");
+    // The text font is needed for layout; icon and page fonts wait for the first show
+    widget->text_font = open_matched_font(widget, job->matches[FONT_TEXT], "monospace:size=10");
+    job->matches[FONT_TEXT] = NULL;
+    widget->icon_font = NULL;
+    widget->page_font = NULL;
+    widget->fonts_loaded = 0;
     
-    widget->text_font = XftFontOpenName(widget->display, DefaultScreen(widget->display), text_pattern);
     if (!widget->text_font)
-        widget->text_font = XftFontOpenName(widget->display, DefaultScreen(widget->display), "monospace:size=10");
+        exit(1);
+}
+
+void close_fonts(Widget *widget) {
+    if (widget->fonts_loaded) {
+        XftFontClose(widget->display, widget->icon_font);
+        XftFontClose(widget->display, widget->page_font);
+    }
+    XftFontClose(widget->display, widget->text_font);
+    for (int i = 0; i < FONT_COUNT; i++) {
+        if (widget->font_job.matches[i])
+            FcPatternDestroy(widget->font_job.matches[i]);
+        widget->font_job.matches[i] = NULL;
+    }
+    widget->fonts_loaded = 0;
+}
+
+void load_deferred_fonts(Widget *widget) {
+    if (widget->fonts_loaded) return;
     
-    widget->page_font = XftFontOpenName(widget->display, DefaultScreen(widget->display), page_pattern);
-    if (!widget->page_font)
-        widget->page_font = XftFontOpenName(widget->display, DefaultScreen(widget->display), "monospace:size=8");
+    uint64_t start_us = monotonic_us();
+    FontMatchJob *job = &widget->font_job;
     
-    if (!widget->icon_font || !widget->text_font || !widget->page_font)
+    widget->icon_font = open_matched_font(widget, job->matches[FONT_ICON], "monospace:size=20");
+    widget->page_font = open_matched_font(widget, job->matches[FONT_PAGE], "monospace:size=8");
+    job->matches[FONT_ICON] = NULL;
+    job->matches[FONT_PAGE] = NULL;
+    
+    if (!widget->icon_font || !widget->page_font)
         exit(1);
+    
+    widget->fonts_loaded = 1;
+    invalidate_page_cache(widget);
+    
+    if (widget->startup_report) {
+        fprintf(stderr, "swgt: deferred fonts loaded on first show in %.2f ms\n",
+                (monotonic_us() - start_us) / 1000.0);
+    }
+}
+
+void mark_startup_phase(Widget *widget, const char *name) {
+    if (widget->startup_phase_count >= MAX_STARTUP_PHASES) return;
+    
+    StartupPhase *phase = &widget->startup_phases[widget->startup_phase_count++];
+    phase->name = name;
+    phase->end_us = monotonic_us();
+}
+
+void print_startup_report(Widget *widget) {
+    uint64_t previous_us = widget->startup_begin_us;
+    
+    for (int i = 0; i < widget->startup_phase_count; i++) {
+        StartupPhase *phase = &widget->startup_phases[i];
+        fprintf(stderr, "swgt: %-10s %8.2f ms\n", phase->name, (phase->end_us - previous_us) / 1000.0);
+        previous_us = phase->end_us;
+    }
+    
+    double total_ms = (previous_us - widget->startup_begin_us) / 1000.0;
+    fprintf(stderr, "swgt: ready in %.2f ms (budget %d ms%s)\n", total_ms, STARTUP_BUDGET_MS,
+            total_ms > STARTUP_BUDGET_MS ? ", EXCEEDED" : "");
 }
 
 void init_widget(Widget *widget) {
+    widget->startup_begin_us = monotonic_us();
+    widget->startup_phase_count = 0;
+    start_zygote(widget);
+    
+    resolve_config_path(widget);
+    widget->config = load_config(widget, &widget->config_size, &widget->config_mapped);
+    mark_startup_phase(widget, "config");
+    
+    // Font matching runs concurrently, and its thread must not take our signals
+    sigset_t mask;
+    block_loop_signals(&mask);
+    XInitThreads();
+    
     widget->display = XOpenDisplay(NULL);
     if (!widget->display)
         exit(1);
     
+    // Commands forked without the zygote must not inherit the connection
+    fcntl(ConnectionNumber(widget->display), F_SETFD, FD_CLOEXEC);
+    
     int screen = DefaultScreen(widget->display);
     widget->root_window = RootWindow(widget->display, screen);
     widget->screen_width = DisplayWidth(widget->display, screen);
     widget->screen_height = DisplayHeight(widget->display, screen);
+    mark_startup_phase(widget, "display");
+    
+    start_font_matching(widget);
+    
+#ifdef USE_XCB
+    widget->xcb = XGetXCBConnection(widget->display);
+    widget->pointer_query_pending = 0;
+#endif
     
-    // Check for compositor
-    widget->has_compositor = check_compositor(widget->display);
+    // Check for compositor; the reply is only needed once the window exists
+    request_compositor_check(widget);
     
     setup_colors(widget);
-    setup_fonts(widget);
     init_buttons(widget);
+    mark_startup_phase(widget, "colors");
     
     widget->hidden_x = widget->screen_width;
-    widget->target_x = widget->screen_width - WIDGET_WIDTH;
+    widget->target_x = widget->screen_width - widget->width;
     widget->current_x = widget->hidden_x;
     widget->is_visible = 0;
     widget->is_closing = 0;
     widget->is_animating = 0;
     widget->mouse_in_zone = 0;
+    widget->pinned = 0;
+    widget->has_focus = 0;
+    widget->pointer_in_hover = 0;
+    widget->pointer_in_widget = 0;
     widget->needs_redraw = 1;
-    widget->frame_count = 0;
+    widget->frame_pending = 0;
+    
+    // Created before the widget so the widget stacks above it
+    create_hover_window(widget);
     
     widget->window = XCreateSimpleWindow(
         widget->display, widget->root_window,
-        widget->current_x, (widget->screen_height - WIDGET_HEIGHT) / 2,
-        WIDGET_WIDTH, WIDGET_HEIGHT, BORDER_WIDTH,
+        widget->current_x, (widget->screen_height - widget->height) / 2,
+        widget->width, widget->height, BORDER_WIDTH,
         widget->window_border_color.pixel, widget->bg_color.pixel
     );
     
@@ -241,9 +4025,13 @@ void init_widget(Widget *widget) {
     XGCValues gc_values;
     gc_values.foreground = widget->text_color.pixel;
     gc_values.background = widget->bg_color.pixel;
-    widget->gc = XCreateGC(widget->display, widget->window, GCForeground | GCBackground, &gc_values);
+    gc_values.graphics_exposures = False;
+    widget->gc = XCreateGC(widget->display, widget->window,
+                           GCForeground | GCBackground | GCGraphicsExposures, &gc_values);
     
-    widget->xft_draw = XftDrawCreate(widget->display, widget->window, widget->visual, widget->colormap);
+    // Pages are rendered into cached surfaces and copied to the window;
+    // no window background so the server never clears it before an Expose
+    XSetWindowBackgroundPixmap(widget->display, widget->window, None);
     
     XSelectInput(widget->display, widget->window, 
                 ExposureMask | ButtonPressMask | ButtonReleaseMask | 
@@ -251,15 +4039,48 @@ void init_widget(Widget *widget) {
                 PointerMotionMask | FocusChangeMask | StructureNotifyMask);
     
     XMapWindow(widget->display, widget->window);
+    mark_startup_phase(widget, "window");
+    
+    // Fonts and XftDraws are only touched here again once the worker is done
+    setup_fonts(widget);
+    setup_page_cache(widget);
+    mark_startup_phase(widget, "fonts");
     
     // Set window opacity after mapping if compositor is available
+    widget->has_compositor = check_compositor(widget);
     if (widget->has_compositor) {
         set_window_opacity(widget, WINDOW_OPACITY);
     }
     
+    setup_present(widget);
+    setup_event_loop(widget);
+    load_page(widget, widget->current_page);
+    setup_config_watch(widget);
+    
     XFlush(widget->display);
+    mark_startup_phase(widget, "ready");
+    
+    if (widget->startup_report) {
+        print_startup_report(widget);
+    }
+}
+
+int point_in_hover_zone(Widget *widget, int x, int y) {
+    int widget_y = (widget->screen_height - widget->height) / 2;
+    return (x >= widget->screen_width - HOVER_ZONE_WIDTH &&
+            y >= widget_y - HOVER_ZONE_HEIGHT && 
+            y <= widget_y + widget->height + HOVER_ZONE_HEIGHT);
+}
+
+int point_over_widget(Widget *widget, int x, int y) {
+    int widget_y = (widget->screen_height - widget->height) / 2;
+    return (x >= widget->current_x && 
+            x <= widget->current_x + widget->width &&
+            y >= widget_y && 
+            y <= widget_y + widget->height);
 }
 
+// Polling fallback, only used when the hover window is unavailable
 int check_mouse_in_hover_zone(Widget *widget) {
     Window root_return, child_return;
     int root_x, root_y, win_x, win_y;
@@ -270,10 +4091,7 @@ int check_mouse_in_hover_zone(Widget *widget) {
                       &root_x, &root_y, &win_x, &win_y, &mask_return))
         return 0;
     
-    int widget_y = (widget->screen_height - WIDGET_HEIGHT) / 2;
-    return (root_x >= widget->screen_width - HOVER_ZONE_WIDTH &&
-            root_y >= widget_y - HOVER_ZONE_HEIGHT && 
-            root_y <= widget_y + WIDGET_HEIGHT + HOVER_ZONE_HEIGHT);
+    return point_in_hover_zone(widget, root_x, root_y);
 }
 
 int check_mouse_over_widget(Widget *widget) {
@@ -286,28 +4104,114 @@ int check_mouse_over_widget(Widget *widget) {
                       &root_x, &root_y, &win_x, &win_y, &mask_return))
         return 0;
     
-    int widget_y = (widget->screen_height - WIDGET_HEIGHT) / 2;
-    return (root_x >= widget->current_x && 
-            root_x <= widget->current_x + WIDGET_WIDTH &&
-            root_y >= widget_y && 
-            root_y <= widget_y + WIDGET_HEIGHT);
+    return point_over_widget(widget, root_x, root_y);
+}
+
+void poll_pointer(Widget *widget) {
+#ifdef USE_XCB
+    // Resolve the query sent on the previous tick, which has long been answered,
+    // then pipeline the next one instead of blocking on it
+    if (widget->pointer_query_pending) {
+        xcb_query_pointer_reply_t *reply = xcb_query_pointer_reply(widget->xcb, widget->pointer_cookie, NULL);
+        if (reply) {
+            widget->pointer_in_hover = point_in_hover_zone(widget, reply->root_x, reply->root_y);
+            widget->pointer_in_widget = point_over_widget(widget, reply->root_x, reply->root_y);
+            free(reply);
+        }
+    }
+    widget->pointer_cookie = xcb_query_pointer(widget->xcb, widget->root_window);
+    widget->pointer_query_pending = 1;
+#else
+    widget->pointer_in_hover = check_mouse_in_hover_zone(widget);
+    widget->pointer_in_widget = check_mouse_over_widget(widget);
+#endif
+}
+
+void create_hover_window(Widget *widget) {
+    widget->hover_window = None;
+    if (HOVER_POLL_FALLBACK) return;
+    
+    // Input-only strip covering the hover zone; crossing events replace polling
+    int top, bottom;
+    hover_zone_span(widget, &top, &bottom);
+    
+    XSetWindowAttributes attrs;
+    attrs.override_redirect = True;
+    attrs.event_mask = EnterWindowMask | LeaveWindowMask;
+    widget->hover_window = XCreateWindow(
+        widget->display, widget->root_window,
+        widget->screen_width - HOVER_ZONE_WIDTH, top,
+        HOVER_ZONE_WIDTH, bottom - top + 1, 0,
+        CopyFromParent, InputOnly, CopyFromParent,
+        CWOverrideRedirect | CWEventMask, &attrs
+    );
+    
+    if (widget->hover_window == None) return;
+    XMapWindow(widget->display, widget->hover_window);
+    
+    // Other override-redirect windows (panels, popups, fullscreen video) stack
+    // above the strip when mapped or raised, so watch the root for restacks
+    XSelectInput(widget->display, widget->root_window, SubstructureNotifyMask);
+}
+
+// Some other top-level window was mapped or restacked; raise the strip back
+// over it, and the widget over the strip while it is open
+void keep_hover_window_on_top(Widget *widget, Window changed) {
+    if (widget->hover_window == None) return;
+    if (changed == widget->hover_window || changed == widget->window) return;
+    
+    XRaiseWindow(widget->display, widget->hover_window);
+    if (widget->is_visible || widget->is_animating)
+        XRaiseWindow(widget->display, widget->window);
+}
+
+void hover_zone_span(Widget *widget, int *top, int *bottom) {
+    int widget_y = (widget->screen_height - widget->height) / 2;
+    *top = widget_y - HOVER_ZONE_HEIGHT;
+    *bottom = widget_y + widget->height + HOVER_ZONE_HEIGHT;
+    if (*top < 0) *top = 0;
+    if (*bottom > widget->screen_height - 1) *bottom = widget->screen_height - 1;
+}
+
+void update_hover_state(Widget *widget) {
+    if (widget->is_animating) return;
+    
+    if (widget->pointer_in_hover && !widget->is_visible && !widget->is_closing) {
+        start_show_animation(widget);
+    } else if (!widget->pointer_in_hover && !widget->pointer_in_widget && !widget->pinned &&
+               widget->is_visible && !widget->is_closing) {
+        widget->mouse_in_zone = 0;
+        // Release focus when hiding the widget
+        if (widget->has_focus) {
+            widget->has_focus = 0;
+            XSetInputFocus(widget->display, PointerRoot, RevertToPointerRoot, CurrentTime);
+        }
+        start_close_animation(widget);
+    }
+}
+
+uint64_t monotonic_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
 }
 
 void animate_widget(Widget *widget) {
-    if (widget->frame_count >= MAX_ANIMATION_FRAMES) {
+    // Position follows elapsed time, so late frames skip ahead instead of slowing the slide
+    uint64_t elapsed_us = monotonic_us() - widget->animation_start_us;
+    
+    if (elapsed_us >= (uint64_t)ANIMATION_DURATION_MS * 1000) {
         widget->current_x = widget->is_closing ? widget->hidden_x : widget->target_x;
         widget->is_visible = !widget->is_closing;
         widget->is_closing = 0;
         widget->is_animating = 0;
-        widget->frame_count = 0;
         
         XMoveWindow(widget->display, widget->window, widget->current_x,
-                   (widget->screen_height - WIDGET_HEIGHT) / 2);
-        widget->needs_redraw = 1;
+                   (widget->screen_height - widget->height) / 2);
         return;
     }
     
-    float frame_progress = (float)widget->frame_count / MAX_ANIMATION_FRAMES;
+    float frame_progress = (float)elapsed_us / (ANIMATION_DURATION_MS * 1000.0f);
     float ease_out = 1.0f - (1.0f - frame_progress) * (1.0f - frame_progress) * (1.0f - frame_progress);
     
     if (widget->is_closing) {
@@ -316,181 +4220,778 @@ void animate_widget(Widget *widget) {
         widget->current_x = widget->hidden_x - (int)((widget->hidden_x - widget->target_x) * ease_out);
     }
     
+    // Contents are unchanged while sliding, so a frame is just a move
     XMoveWindow(widget->display, widget->window, widget->current_x,
-               (widget->screen_height - WIDGET_HEIGHT) / 2);
+               (widget->screen_height - widget->height) / 2);
+}
+
+Bool present_wire_to_cookie(Display *display, XGenericEventCookie *cookie, xEvent *event) {
+    xGenericEvent *ge = (xGenericEvent *)event;
     
-    widget->needs_redraw = 1;
-    widget->frame_count++;
+    cookie->type = ge->type & 0x7f;
+    cookie->serial = _XSetLastRequestRead(display, (xGenericReply *)event);
+    cookie->send_event = (ge->type & 0x80) != 0;
+    cookie->display = display;
+    cookie->extension = ge->extension;
+    cookie->evtype = ge->evtype;
+    cookie->data = NULL;
+    
+    // Only the serial is needed to match a completion to its request
+    if (ge->evtype == PresentCompleteNotify) {
+        uint32_t *serial = Xmalloc(sizeof(uint32_t));
+        if (serial) {
+            *serial = ((xPresentCompleteNotify *)event)->serial;
+            cookie->data = serial;
+        }
+    }
+    return True;
+}
+
+void setup_present(Widget *widget) {
+    // Xlib request macros expect the connection to be called dpy
+    Display *dpy = widget->display;
+    int opcode, event_base, error_base;
+    
+    widget->present_opcode = 0;
+    widget->present_notify_pending = 0;
+    widget->present_serial = 0;
+    if (!XQueryExtension(dpy, "Present", &opcode, &event_base, &error_base))
+        return;
+    
+    xPresentQueryVersionReq *version_req;
+    xPresentQueryVersionReply version_rep;
+    LockDisplay(dpy);
+    version_req = _XGetRequest(dpy, opcode, sz_xPresentQueryVersionReq);
+    version_req->presentReqType = X_PresentQueryVersion;
+    version_req->majorVersion = 1;
+    version_req->minorVersion = 0;
+    Status ok = _XReply(dpy, (xReply *)&version_rep, 0, xTrue);
+    UnlockDisplay(dpy);
+    SyncHandle();
+    if (!ok) return;
+    
+    XESetWireToEventCookie(dpy, opcode, present_wire_to_cookie);
+    widget->present_eid = XAllocID(dpy);
+    
+    xPresentSelectInputReq *select_req;
+    LockDisplay(dpy);
+    select_req = _XGetRequest(dpy, opcode, sz_xPresentSelectInputReq);
+    select_req->presentReqType = X_PresentSelectInput;
+    select_req->eid = widget->present_eid;
+    select_req->window = widget->window;
+    select_req->eventMask = PresentCompleteNotifyMask;
+    UnlockDisplay(dpy);
+    SyncHandle();
+    
+    widget->present_opcode = opcode;
+}
+
+void request_present_notify(Widget *widget) {
+    // Xlib request macros expect the connection to be called dpy
+    Display *dpy = widget->display;
+    xPresentNotifyMSCReq *req;
+    
+    // divisor 1, remainder 0: complete at the next vblank
+    LockDisplay(dpy);
+    req = _XGetRequest(dpy, widget->present_opcode, sz_xPresentNotifyMSCReq);
+    req->presentReqType = X_PresentNotifyMSC;
+    req->window = widget->window;
+    req->serial = ++widget->present_serial;
+    req->pad0 = 0;
+    req->target_msc = 0;
+    req->divisor = 1;
+    req->remainder = 0;
+    UnlockDisplay(dpy);
+    SyncHandle();
+    
+    widget->present_notify_pending = 1;
+}
+
+void handle_present_event(Widget *widget, XGenericEventCookie *cookie) {
+    if (cookie->evtype != PresentCompleteNotify || !cookie->data) return;
+    
+    // Completions of notifies superseded after a watchdog tick are stale
+    if (*(uint32_t *)cookie->data != widget->present_serial) return;
+    
+    widget->present_notify_pending = 0;
+    if (widget->frame_pending) {
+        run_frame(widget);
+    }
 }
 
 void start_close_animation(Widget *widget) {
     if (widget->is_visible && !widget->is_closing && !widget->is_animating) {
+        stop_filter(widget);
+        widget->pinned = 0;
         widget->is_closing = 1;
         widget->is_animating = 1;
-        widget->frame_count = 0;
+        widget->animation_start_us = monotonic_us();
+        arm_probe_timer(widget, 0);
     }
 }
 
 void start_show_animation(Widget *widget) {
     if (!widget->is_visible && !widget->is_closing && !widget->is_animating) {
+        load_deferred_fonts(widget);
+        flush_live_labels(widget);
+        refresh_probes(widget);
+        if (PROBE_INTERVAL_MS > 0) arm_probe_timer(widget, PROBE_INTERVAL_MS);
         widget->mouse_in_zone = 1;
         widget->is_animating = 1;
-        widget->frame_count = 0;
+        widget->animation_start_us = monotonic_us();
+        // Windows raised while it was hidden may cover it
+        XRaiseWindow(widget->display, widget->window);
+        update_countdowns(widget);
+        if (widget->work.fd >= 0) update_work_buttons(widget);
+    }
+}
+
+void layout_text(Widget *widget, TextLayout *layout, const char *text, XftFont *font, int y, int width) {
+    const FcChar8 *cursor = (const FcChar8 *)text;
+    int remaining = strlen(text);
+    
+    layout->count = 0;
+    while (remaining > 0 && layout->count < MAX_LABEL_GLYPHS) {
+        FcChar32 ucs4;
+        int used = FcUtf8ToUcs4(cursor, &ucs4, remaining);
+        if (used <= 0) break;
+        
+        layout->glyphs[layout->count] = XftCharIndex(widget->display, font, ucs4);
+        layout->count++;
+        cursor += used;
+        remaining -= used;
+    }
+    
+    XGlyphInfo extents = {0};
+    if (layout->count > 0) {
+        // Upload the bitmaps now so the first show does not stall on rasterizing
+        XftFontLoadGlyphs(widget->display, font, FcTrue, layout->glyphs, layout->count);
+        XftGlyphExtents(widget->display, font, layout->glyphs, layout->count, &extents);
+        
+        // Per-glyph advances let the label join a batched glyph-spec run
+        for (int i = 0; i < layout->count; i++) {
+            XGlyphInfo glyph;
+            XftGlyphExtents(widget->display, font, &layout->glyphs[i], 1, &glyph);
+            layout->advances[i] = glyph.xOff;
+        }
+    }
+    
+    layout->x = (width - extents.width) / 2;
+    layout->y = y;
+}
+
+// Lays out the labels of the page a surface has just taken
+const char *button_label(Widget *widget, int page, int index) {
+    resolve_slot(widget, &page, &index);
+    const ButtonCommands *commands = &widget->pages[page].commands[index];
+    if (commands->label) return commands->label;
+    if (commands->timer_deadline_us) return commands->countdown;
+    if (commands->work >= 0 && widget->work.label[0]) return widget->work.label;
+    if (commands->live >= 0 && widget->live_labels[commands->live].has_text)
+        return widget->live_labels[commands->live].text;
+    return config_string(widget->config, button_entry(widget, page, index)->text);
+}
+
+void layout_button(Widget *widget, PageSurface *surface, int index) {
+    const ConfigButton *entry = button_entry(widget, surface->page, index);
+    if (!entry || !widget->fonts_loaded) return;
+    
+    // Labels are centred in the button, whatever cells it covers
+    const XRectangle *rect = &page_slots(widget, surface->page)->rects[index];
+    int icon_area_height = rect->height - ICON_TEXT_SPACING - widget->text_font->height - 16;
+    int icon_y = icon_area_height / 2 + widget->icon_font->ascent / 2 + 8;
+    int text_y = rect->height - widget->text_font->descent - 8;
+    layout_text(widget, &surface->labels[2 * index], config_string(widget->config, entry->icon),
+                widget->icon_font, icon_y, rect->width);
+    layout_text(widget, &surface->labels[2 * index + 1], button_label(widget, surface->page, index),
+                widget->text_font, text_y, rect->width);
+}
+
+// A changed label is laid out again only on the surfaces showing its button
+void relayout_button(Widget *widget, int page, int index) {
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        PageSurface *surface = &widget->page_cache[i];
+        if (surface->page == page) layout_button(widget, surface, index);
+        if (surface->page != FILTER_PAGE) continue;
+        
+        for (int slot = 0; slot < widget->filter.view.button_count; slot++) {
+            int slot_page = FILTER_PAGE, slot_index = slot;
+            resolve_slot(widget, &slot_page, &slot_index);
+            if (slot_page == page && slot_index == index) layout_button(widget, surface, slot);
+        }
+    }
+    damage_page(widget, page, DAMAGE_BUTTON(index));
+}
+
+void layout_surface(Widget *widget, PageSurface *surface) {
+    Page *slots = page_slots(widget, surface->page);
+    
+    if (slots->button_count > surface->label_capacity) {
+        free(surface->labels);
+        surface->labels = calloc(slots->button_count * 2, sizeof(TextLayout));
+        if (!surface->labels) exit(1);
+        surface->label_capacity = slots->button_count;
+    }
+    if (!widget->fonts_loaded) return;
+    
+    for (int i = 0; i < slots->button_count; i++) {
+        layout_button(widget, surface, i);
+    }
+    
+    // Page numbers are laid out across the whole widget; the filter shows
+    // as much of the end of its query as fits instead
+    char page_text[MAX_QUERY_LENGTH + 8];
+    int indicator_y = widget->height - PAGE_INDICATOR_HEIGHT - WIDGET_PADDING;
+    if (surface->page == FILTER_PAGE) {
+        int fit = (widget->width - 2 * WIDGET_PADDING) / widget->page_font->max_advance_width - 1;
+        int skip = widget->filter.length > fit ? widget->filter.length - (fit > 0 ? fit : 0) : 0;
+        snprintf(page_text, sizeof(page_text), "/%s", widget->filter.query + skip);
+    } else {
+        snprintf(page_text, sizeof(page_text), "%d/%d", surface->page + 1, widget->total_pages);
+    }
+    layout_text(widget, &surface->number, page_text, widget->page_font,
+                indicator_y + PAGE_DOT_SIZE + 12, widget->width);
+}
+
+void submit_render_list(Widget *widget, PageSurface *surface) {
+    RenderList *list = &widget->render_list;
+    Picture picture = XftDrawPicture(surface->xft_draw);
+    
+    for (int layer = 0; layer < LAYER_COUNT; layer++) {
+        for (int i = 0; i < list->rect_batch_count; i++) {
+            RectBatch *batch = &list->rect_batches[i];
+            if (batch->layer != layer || batch->count == 0) continue;
+            
+            if (picture) {
+                XRenderColor color = { batch->color->red, batch->color->green, batch->color->blue, 0xffff };
+                XRenderFillRectangles(widget->display, PictOpSrc, picture, &color, batch->rects, batch->count);
+            } else {
+                XSetForeground(widget->display, widget->gc, batch->color->pixel);
+                XFillRectangles(widget->display, surface->pixmap, widget->gc, batch->rects, batch->count);
+            }
+        }
+    }
+    
+    for (int i = 0; i < list->glyph_batch_count; i++) {
+        GlyphBatch *batch = &list->glyph_batches[i];
+        XftDrawGlyphSpec(surface->xft_draw, batch->color, batch->font, batch->specs, batch->count);
+    }
+    
+    list->rect_batch_count = 0;
+    list->glyph_batch_count = 0;
+}
+
+void push_rect(Widget *widget, int layer, XColor *color, int x, int y, int width, int height) {
+    RenderList *list = &widget->render_list;
+    RectBatch *batch = NULL;
+    
+    for (int i = 0; i < list->rect_batch_count; i++) {
+        if (list->rect_batches[i].layer == layer && list->rect_batches[i].color == color) {
+            batch = &list->rect_batches[i];
+            break;
+        }
+    }
+    
+    if (!batch) {
+        if (list->rect_batch_count == list->rect_batch_capacity) {
+            int old_capacity = list->rect_batch_capacity;
+            list->rect_batch_capacity = old_capacity ? old_capacity * 2 : 16;
+            list->rect_batches = realloc(list->rect_batches, list->rect_batch_capacity * sizeof(RectBatch));
+            if (!list->rect_batches) exit(1);
+            memset(list->rect_batches + old_capacity, 0, (list->rect_batch_capacity - old_capacity) * sizeof(RectBatch));
+        }
+        // Slots past the count keep their arrays from earlier frames
+        batch = &list->rect_batches[list->rect_batch_count++];
+        batch->layer = layer;
+        batch->color = color;
+        batch->count = 0;
+    }
+    
+    if (batch->count == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 64;
+        batch->rects = realloc(batch->rects, batch->capacity * sizeof(XRectangle));
+        if (!batch->rects) exit(1);
+    }
+    
+    XRectangle *rect = &batch->rects[batch->count++];
+    rect->x = x;
+    rect->y = y;
+    rect->width = width;
+    rect->height = height;
+}
+
+void push_outline(Widget *widget, int layer, XColor *color, int x, int y, int width, int height) {
+    // Same pixels as XDrawRectangle: the outline spans width + 1 by height + 1
+    push_rect(widget, layer, color, x, y, width + 1, 1);
+    push_rect(widget, layer, color, x, y + height, width + 1, 1);
+    push_rect(widget, layer, color, x, y + 1, 1, height - 1);
+    push_rect(widget, layer, color, x + width, y + 1, 1, height - 1);
+}
+
+void draw_text_layout(Widget *widget, TextLayout *layout, int x, int y, XftFont *font, XftColor *color) {
+    if (layout->count == 0) return;
+    
+    RenderList *list = &widget->render_list;
+    GlyphBatch *batch = NULL;
+    
+    for (int i = 0; i < list->glyph_batch_count; i++) {
+        if (list->glyph_batches[i].font == font && list->glyph_batches[i].color == color) {
+            batch = &list->glyph_batches[i];
+            break;
+        }
+    }
+    
+    if (!batch) {
+        if (list->glyph_batch_count == list->glyph_batch_capacity) {
+            int old_capacity = list->glyph_batch_capacity;
+            list->glyph_batch_capacity = old_capacity ? old_capacity * 2 : 8;
+            list->glyph_batches = realloc(list->glyph_batches, list->glyph_batch_capacity * sizeof(GlyphBatch));
+            if (!list->glyph_batches) exit(1);
+            memset(list->glyph_batches + old_capacity, 0, (list->glyph_batch_capacity - old_capacity) * sizeof(GlyphBatch));
+        }
+        batch = &list->glyph_batches[list->glyph_batch_count++];
+        batch->font = font;
+        batch->color = color;
+        batch->count = 0;
+    }
+    
+    if (batch->count + layout->count > batch->capacity) {
+        while (batch->count + layout->count > batch->capacity)
+            batch->capacity = batch->capacity ? batch->capacity * 2 : 256;
+        batch->specs = realloc(batch->specs, batch->capacity * sizeof(XftGlyphSpec));
+        if (!batch->specs) exit(1);
+    }
+    
+    int pen_x = x + layout->x;
+    for (int i = 0; i < layout->count; i++) {
+        XftGlyphSpec *spec = &batch->specs[batch->count++];
+        spec->glyph = layout->glyphs[i];
+        spec->x = pen_x;
+        spec->y = y + layout->y;
+        pen_x += layout->advances[i];
+    }
+}
+
+void get_button_rect(Widget *widget, int page, int index, XRectangle *rect) {
+    // Includes the widest (pressed) border, which grows outwards from the button
+    const XRectangle *button = &page_slots(widget, page)->rects[index];
+    rect->x = button->x - 2;
+    rect->y = button->y - 2;
+    rect->width = button->width + 5;
+    rect->height = button->height + 5;
+}
+
+void get_indicator_rect(Widget *widget, XRectangle *rect) {
+    int indicator_y = widget->height - PAGE_INDICATOR_HEIGHT - WIDGET_PADDING;
+    rect->x = 0;
+    rect->y = indicator_y - 1;
+    rect->width = widget->width;
+    rect->height = widget->height - indicator_y + 1;
+}
+
+void clear_region(Widget *widget, XRectangle *rect) {
+    push_rect(widget, LAYER_CLEAR, &widget->bg_color, rect->x, rect->y, rect->width, rect->height);
+}
+
+void draw_button(Widget *widget, PageSurface *surface, int index) {
+    if (!(surface->damage & DAMAGE_BUTTON(index))) return;
+    
+    // Partial repaints start from a clean background
+    if (surface->damage != DAMAGE_ALL) {
+        XRectangle rect;
+        get_button_rect(widget, surface->page, index, &rect);
+        clear_region(widget, &rect);
+    }
+    
+    // Skip empty buttons
+    Page *page = page_slots(widget, surface->page);
+    if (index >= page->button_count) return;
+    const XRectangle *rect = &page->rects[index];
+    int button_page = surface->page, button_index = index;
+    resolve_slot(widget, &button_page, &button_index);
+    Button *button = &widget->pages[button_page].buttons[button_index];
+    if (!button->present) return;
+    int button_x = rect->x;
+    int button_y = rect->y;
+    
+    XColor *bg_color, *border_color;
+    XftColor *text_color, *icon_color;
+    
+    if (button->is_pressed) {
+        bg_color = &widget->pressed_bg_color;
+        border_color = &widget->active_border_color;
+        text_color = &widget->xft_active_text_color;
+        icon_color = &widget->xft_active_icon_color;
+    } else if (button->is_active) {
+        bg_color = &widget->active_bg_color;
+        border_color = &widget->active_border_color;
+        text_color = &widget->xft_active_text_color;
+        icon_color = &widget->xft_active_icon_color;
+    } else {
+        bg_color = &widget->button_bg_color;
+        border_color = &widget->border_color;
+        text_color = &widget->xft_text_color;
+        icon_color = &widget->xft_icon_color;
+    }
+    
+    // Command status overrides the border: running children, then the last failure,
+    // then a state the probe has yet to confirm
+    if (button->pid) {
+        border_color = &widget->running_border_color;
+    } else if (button->failed) {
+        border_color = &widget->failed_border_color;
+    } else if (button->stale) {
+        border_color = &widget->stale_border_color;
+    }
+    
+    push_rect(widget, LAYER_FILL, bg_color, button_x, button_y, rect->width, rect->height);
+    
+    int border_thickness = button->is_pressed ? 3 : 2;
+    
+    for (int i = 0; i < border_thickness; i++) {
+        push_outline(widget, LAYER_BORDER, border_color, button_x - i, button_y - i,
+                     rect->width + 2 * i, rect->height + 2 * i);
+    }
+    
+    draw_text_layout(widget, &surface->labels[2 * index], button_x, button_y, widget->icon_font, icon_color);
+    draw_text_layout(widget, &surface->labels[2 * index + 1], button_x, button_y, widget->text_font, text_color);
+}
+
+void draw_page_indicator(Widget *widget, PageSurface *surface) {
+    if (!(surface->damage & DAMAGE_INDICATOR)) return;
+    
+    if (surface->damage != DAMAGE_ALL) {
+        XRectangle rect;
+        get_indicator_rect(widget, &rect);
+        clear_region(widget, &rect);
+    }
+    
+    if (surface->page == FILTER_PAGE) {
+        draw_text_layout(widget, &surface->number, 0, 0, widget->page_font, &widget->xft_page_active_color);
+        return;
+    }
+    if (widget->total_pages <= 1) return;
+    
+    // At most INDICATOR_DOTS dots, a window that follows the current page.
+    // Shrunken end dots tell that more pages lie beyond, so the cost and the
+    // width stay the same at any page count
+    int page = surface->page;
+    int dots = widget->total_pages < INDICATOR_DOTS ? widget->total_pages : INDICATOR_DOTS;
+    int first = page - dots / 2;
+    if (first > widget->total_pages - dots) first = widget->total_pages - dots;
+    if (first < 0) first = 0;
+    
+    int indicator_y = widget->height - PAGE_INDICATOR_HEIGHT - WIDGET_PADDING;
+    int total_width = dots * PAGE_DOT_SIZE + (dots - 1) * PAGE_DOT_SPACING;
+    int start_x = (widget->width - total_width) / 2;
+    
+    for (int i = 0; i < dots; i++) {
+        int shown = first + i;
+        int radius = PAGE_DOT_SIZE / 2;
+        if ((i == 0 && first > 0) || (i == dots - 1 && first + dots < widget->total_pages)) {
+            if (radius > 1) radius--;
+        }
+        
+        int dot_center_x = start_x + i * (PAGE_DOT_SIZE + PAGE_DOT_SPACING) + PAGE_DOT_SIZE / 2;
+        int dot_center_y = indicator_y + PAGE_DOT_SIZE / 2;
+        XColor *color = (shown == page) ? &widget->page_active_color : &widget->page_color;
+        push_dot(widget, dot_center_x, dot_center_y, radius, color, shown != page);
+    }
+    
+    // Draw page numbers with better styling
+    draw_text_layout(widget, &surface->number, 0, 0, widget->page_font, &widget->xft_page_color);
+}
+
+void push_dot(Widget *widget, int center_x, int center_y, int radius, XColor *color, int outlined) {
+    // Rasterize the dot as one span per row so it joins the rect batches
+    for (int dy = -radius; dy < radius; dy++) {
+        double row = dy + 0.5;
+        int half = (int)lround(sqrt((double)radius * radius - row * row));
+        if (half <= 0) continue;
+        push_rect(widget, LAYER_FILL, color, center_x - half, center_y + dy, half * 2, 1);
+        
+        // Add subtle border for inactive dots: the row's end pixels plus
+        // any run exposed by the narrower neighbouring row
+        if (outlined) {
+            double inner = fabs(row) + 1.0;
+            int next = inner < radius ? (int)lround(sqrt((double)radius * radius - inner * inner)) : 0;
+            int edge = half - next > 1 ? half - next : 1;
+            push_rect(widget, LAYER_BORDER, &widget->border_color, center_x - half, center_y + dy, edge, 1);
+            push_rect(widget, LAYER_BORDER, &widget->border_color, center_x + half - edge, center_y + dy, edge, 1);
+        }
+    }
+}
+
+void setup_page_cache(Widget *widget) {
+    int depth = DefaultDepth(widget->display, DefaultScreen(widget->display));
+    
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        PageSurface *surface = &widget->page_cache[i];
+        surface->pixmap = XCreatePixmap(widget->display, widget->window, widget->width, widget->height, depth);
+        surface->xft_draw = XftDrawCreate(widget->display, surface->pixmap, widget->visual, widget->colormap);
+        surface->page = -1;
+        surface->damage = DAMAGE_ALL;
+        surface->repainted = 0;
+        surface->last_used = 0;
+        surface->labels = NULL;
+        surface->label_capacity = 0;
+    }
+    
+    widget->front_surface = NULL;
+    widget->front_page = -1;
+    widget->cache_clock = 0;
+}
+
+void teardown_page_cache(Widget *widget) {
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        XftDrawDestroy(widget->page_cache[i].xft_draw);
+        XFreePixmap(widget->display, widget->page_cache[i].pixmap);
+        free(widget->page_cache[i].labels);
+    }
+    widget->front_surface = NULL;
+}
+
+// Every cached page is laid out and rendered again when next needed
+void invalidate_page_cache(Widget *widget) {
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        widget->page_cache[i].page = -1;
+        widget->page_cache[i].damage = DAMAGE_ALL;
+    }
+    widget->front_page = -1;
+    widget->needs_redraw = 1;
+}
+
+void resize_widget(Widget *widget, int width, int height) {
+    widget->width = width;
+    widget->height = height;
+    teardown_page_cache(widget);
+    setup_page_cache(widget);
+    widget->needs_redraw = 1;
+    
+    // A shown widget stays flush with the screen edge
+    widget->target_x = widget->screen_width - width;
+    if (widget->is_visible && !widget->is_animating) widget->current_x = widget->target_x;
+    XMoveResizeWindow(widget->display, widget->window, widget->current_x,
+                      (widget->screen_height - height) / 2, width, height);
+    if (widget->hover_window != None) {
+        int top, bottom;
+        hover_zone_span(widget, &top, &bottom);
+        XMoveResizeWindow(widget->display, widget->hover_window, widget->screen_width - HOVER_ZONE_WIDTH, top,
+                          HOVER_ZONE_WIDTH, bottom - top + 1);
     }
 }
 
-void draw_text_centered_xft(Widget *widget, const char *text, int x, int y, int width, XftFont *font, XftColor *color) {
-    if (!text || !text[0]) return;
+void render_page(Widget *widget, PageSurface *surface) {
+    if (!surface->damage) return;
     
-    XGlyphInfo extents;
-    XftTextExtentsUtf8(widget->display, font, (FcChar8*)text, strlen(text), &extents);
-    
-    int text_x = x + (width - extents.width) / 2;
-    XftDrawStringUtf8(widget->xft_draw, color, font, text_x, y, (FcChar8*)text, strlen(text));
-}
-
-void draw_button(Widget *widget, int index) {
-    Button *button = &widget->buttons[widget->current_page][index];
+    if (surface->damage == DAMAGE_ALL) {
+        push_rect(widget, LAYER_CLEAR, &widget->bg_color, 0, 0, widget->width, widget->height);
+    }
     
-    // Skip empty buttons
-    if (button->icon[0] == '\0') return;
+    for (int i = 0; i < page_slots(widget, surface->page)->button_count; i++) {
+        draw_button(widget, surface, i);
+    }
     
-    int button_x = WIDGET_PADDING;
-    int button_y = WIDGET_PADDING + index * (BUTTON_SIZE + BUTTON_MARGIN);
+    draw_page_indicator(widget, surface);
+    submit_render_list(widget, surface);
     
-    XColor *bg_color, *border_color;
-    XftColor *text_color, *icon_color;
+    surface->repainted |= surface->damage;
+    surface->damage = 0;
+}
+
+PageSurface *get_page_surface(Widget *widget, int page) {
+    PageSurface *victim = NULL;
     
-    if (button->is_pressed) {
-        bg_color = &widget->pressed_bg_color;
-        border_color = &widget->active_border_color;
-        text_color = &widget->xft_active_text_color;
-        icon_color = &widget->xft_active_icon_color;
-    } else if (button->is_active) {
-        bg_color = &widget->active_bg_color;
-        border_color = &widget->active_border_color;
-        text_color = &widget->xft_active_text_color;
-        icon_color = &widget->xft_active_icon_color;
-    } else {
-        bg_color = &widget->button_bg_color;
-        border_color = &widget->border_color;
-        text_color = &widget->xft_text_color;
-        icon_color = &widget->xft_icon_color;
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        PageSurface *surface = &widget->page_cache[i];
+        if (surface->page == page) {
+            victim = surface;
+            break;
+        }
+        // Evict the least recently used slot, never the one on screen
+        if (surface != widget->front_surface &&
+            (!victim || surface->page < 0 || (victim->page >= 0 && surface->last_used < victim->last_used))) {
+            victim = surface;
+        }
     }
     
-    XSetForeground(widget->display, widget->gc, bg_color->pixel);
-    XFillRectangle(widget->display, widget->window, widget->gc,
-                   button_x, button_y, BUTTON_SIZE, BUTTON_SIZE);
+    if (victim->page != page) {
+        victim->page = page;
+        victim->damage = DAMAGE_ALL;
+        if (page != FILTER_PAGE) load_page(widget, page);
+        layout_surface(widget, victim);
+    }
+    render_page(widget, victim);
+    victim->last_used = ++widget->cache_clock;
+    return victim;
+}
+
+void prerender_neighbours(Widget *widget) {
+    if (widget->total_pages <= 1) return;
     
-    XSetForeground(widget->display, widget->gc, border_color->pixel);
-    int border_thickness = button->is_pressed ? 3 : 2;
+    int prev = (widget->current_page + widget->total_pages - 1) % widget->total_pages;
+    int next = (widget->current_page + 1) % widget->total_pages;
     
-    for (int i = 0; i < border_thickness; i++) {
-        XDrawRectangle(widget->display, widget->window, widget->gc,
-                       button_x - i, button_y - i,
-                       BUTTON_SIZE + 2 * i, BUTTON_SIZE + 2 * i);
+    get_page_surface(widget, next);
+    if (prev != next) {
+        get_page_surface(widget, prev);
+    }
+    // Keep the visible page the most recently used entry
+    if (widget->front_surface) {
+        widget->front_surface->last_used = ++widget->cache_clock;
+    }
+}
+
+void damage_page(Widget *widget, int page, DamageMask damage) {
+    // Pages without a cached surface are rendered in full when next needed
+    for (int i = 0; i < PAGE_CACHE_SIZE; i++) {
+        if (widget->page_cache[i].page == page) {
+            widget->page_cache[i].damage |= damage;
+        }
     }
     
-    int icon_area_height = BUTTON_SIZE - ICON_TEXT_SPACING - widget->text_font->height - 16;
-    int icon_y = button_y + icon_area_height / 2 + widget->icon_font->ascent / 2 + 8;
-    int text_y = button_y + BUTTON_SIZE - widget->text_font->descent - 8;
+    // Buttons among the filter results are repainted there as well
+    if (widget->filter.active && page != FILTER_PAGE) {
+        for (int i = 0; i < widget->filter.view.button_count; i++) {
+            const ConfigButton *entry = &config_buttons(widget->config)[widget->filter.shown[i]];
+            if ((int)entry->page == page && (damage & DAMAGE_BUTTON(entry->slot)))
+                damage_page(widget, FILTER_PAGE, DAMAGE_BUTTON(i));
+        }
+    }
     
-    draw_text_centered_xft(widget, button->icon, button_x, icon_y, BUTTON_SIZE, widget->icon_font, icon_color);
-    draw_text_centered_xft(widget, button->text, button_x, text_y, BUTTON_SIZE, widget->text_font, text_color);
+    if (page == shown_page(widget)) {
+        widget->needs_redraw = 1;
+    }
 }
 
-void draw_page_indicator(Widget *widget) {
-    if (widget->total_pages <= 1) return;
-    
-    int indicator_y = WIDGET_HEIGHT - PAGE_INDICATOR_HEIGHT - WIDGET_PADDING;
-    int total_width = widget->total_pages * PAGE_DOT_SIZE + (widget->total_pages - 1) * PAGE_DOT_SPACING;
-    int start_x = (WIDGET_WIDTH - total_width) / 2;
+void flash_damage(Widget *widget, DamageMask damage) {
+    XRectangle rect;
     
-    for (int i = 0; i < widget->total_pages; i++) {
-        int dot_x = start_x + i * (PAGE_DOT_SIZE + PAGE_DOT_SPACING);
-        int dot_center_x = dot_x + PAGE_DOT_SIZE / 2;
-        int dot_center_y = indicator_y + PAGE_DOT_SIZE / 2;
-        int radius = PAGE_DOT_SIZE / 2;
-        
-        XColor *color = (i == widget->current_page) ? &widget->page_active_color : &widget->page_color;
-        XSetForeground(widget->display, widget->gc, color->pixel);
-        
-        // Draw filled circle using XFillArc (360 degrees = 360 * 64 in X11)
-        XFillArc(widget->display, widget->window, widget->gc,
-                 dot_center_x - radius, dot_center_y - radius,
-                 PAGE_DOT_SIZE, PAGE_DOT_SIZE, 0, 360 * 64);
-        
-        // Add subtle border for inactive dots to make them more defined
-        if (i != widget->current_page) {
-            XSetForeground(widget->display, widget->gc, widget->border_color.pixel);
-            XDrawArc(widget->display, widget->window, widget->gc,
-                     dot_center_x - radius, dot_center_y - radius,
-                     PAGE_DOT_SIZE, PAGE_DOT_SIZE, 0, 360 * 64);
+    XSetForeground(widget->display, widget->gc, widget->active_border_color.pixel);
+    for (int i = 0; i < page_slots(widget, shown_page(widget))->button_count; i++) {
+        if (damage & DAMAGE_BUTTON(i)) {
+            get_button_rect(widget, shown_page(widget), i, &rect);
+            XFillRectangle(widget->display, widget->window, widget->gc, rect.x, rect.y, rect.width, rect.height);
         }
     }
+    if (damage & DAMAGE_INDICATOR) {
+        get_indicator_rect(widget, &rect);
+        XFillRectangle(widget->display, widget->window, widget->gc, rect.x, rect.y, rect.width, rect.height);
+    }
     
-    // Draw page numbers with better styling
-    char page_text[16];
-    snprintf(page_text, sizeof(page_text), "%d/%d", widget->current_page + 1, widget->total_pages);
+    XSync(widget->display, False);
+    usleep(FLASH_DAMAGE_MS * 1000);
+}
+
+void present_widget(Widget *widget, int x, int y, int width, int height) {
+    if (!widget->front_surface) return;
     
-    XftColor *text_color = &widget->xft_page_color;
-    int text_y = indicator_y + PAGE_DOT_SIZE + 12;
-    draw_text_centered_xft(widget, page_text, 0, text_y, WIDGET_WIDTH, widget->page_font, text_color);
+    XCopyArea(widget->display, widget->front_surface->pixmap, widget->window, widget->gc,
+              x, y, width, height, x, y);
 }
 
 void draw_widget(Widget *widget) {
     if (!widget->needs_redraw) return;
     
-    // Clear entire window to prevent trails
-    XClearWindow(widget->display, widget->window);
+    unsigned long first_request = NextRequest(widget->display);
+    
+    // A cached page costs a single copy; stale or missing pages are rendered first
+    int page = shown_page(widget);
+    PageSurface *surface = get_page_surface(widget, page);
+    DamageMask repainted = surface->repainted;
     
-    XSetForeground(widget->display, widget->gc, widget->bg_color.pixel);
-    XFillRectangle(widget->display, widget->window, widget->gc,
-                   0, 0, WIDGET_WIDTH, WIDGET_HEIGHT);
+    // A different page is copied whole, the same page only where it changed
+    if (surface != widget->front_surface || widget->front_page != page)
+        repainted = DAMAGE_ALL;
+    widget->front_surface = surface;
+    widget->front_page = page;
+    surface->repainted = 0;
+    
+    if (FLASH_DAMAGE_MS > 0 && repainted) {
+        flash_damage(widget, repainted);
+    }
     
-    for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
-        draw_button(widget, i);
+    if (repainted == DAMAGE_ALL) {
+        present_widget(widget, 0, 0, widget->width, widget->height);
+    } else {
+        XRectangle rect;
+        for (int i = 0; i < page_slots(widget, page)->button_count; i++) {
+            if (repainted & DAMAGE_BUTTON(i)) {
+                get_button_rect(widget, page, i, &rect);
+                present_widget(widget, rect.x, rect.y, rect.width, rect.height);
+            }
+        }
+        if (repainted & DAMAGE_INDICATOR) {
+            get_indicator_rect(widget, &rect);
+            present_widget(widget, rect.x, rect.y, rect.width, rect.height);
+        }
     }
     
-    draw_page_indicator(widget);
+    if (widget->frame_report)
+        fprintf(stderr, "swgt: frame used %lu requests\n", NextRequest(widget->display) - first_request);
     
     XFlush(widget->display);
     widget->needs_redraw = 0;
 }
 
 int get_button_at_position(Widget *widget, int x, int y) {
-    (void)widget;
+    Page *slots = page_slots(widget, shown_page(widget));
+    int pitch = BUTTON_SIZE + BUTTON_MARGIN;
     
-    for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
-        int button_x = WIDGET_PADDING;
-        int button_y = WIDGET_PADDING + i * (BUTTON_SIZE + BUTTON_MARGIN);
-        
-        if (x >= button_x && x <= button_x + BUTTON_SIZE &&
-            y >= button_y && y <= button_y + BUTTON_SIZE) {
-            return i;
-        }
-    }
-    return -1;
+    // The point picks its grid cell directly; the button there still has to
+    // contain it, since margins between buttons belong to none
+    if (!slots->hit_map || x < WIDGET_PADDING || y < WIDGET_PADDING) return -1;
+    int column = (x - WIDGET_PADDING) / pitch, row = (y - WIDGET_PADDING) / pitch;
+    if (column >= slots->columns || row >= slots->rows) return -1;
+    
+    int index = slots->hit_map[row * slots->columns + column];
+    if (index == NO_HIT || index >= slots->button_count) return -1;
+    
+    const XRectangle *rect = &slots->rects[index];
+    if (x > rect->x + rect->width || y > rect->y + rect->height) return -1;
+    return index;
 }
 
-void toggle_button(Widget *widget, int button_index) {
-    if (button_index < 0 || button_index >= BUTTONS_PER_PAGE) return;
+void toggle_button(Widget *widget, int page, int button_index) {
+    Page *slots = &widget->pages[page];
+    if (button_index < 0 || button_index >= slots->button_count) return;
     
-    Button *button = &widget->buttons[widget->current_page][button_index];
+    Button *button = &slots->buttons[button_index];
     
     // Skip empty buttons
-    if (button->icon[0] == '\0') return;
+    if (!button->present) return;
+    
+    // A work button starts or ends the one session there is
+    if (slots->commands[button_index].work >= 0) {
+        if (widget->work.session) stop_work_session(widget);
+        else start_work_session(widget, slots->commands[button_index].work);
+        return;
+    }
+    
+    // Timers run in-process; every click adds to the countdown
+    if (slots->commands[button_index].timer_step) {
+        add_timer_time(widget, page, button_index, slots->commands[button_index].timer_step);
+        return;
+    }
     
     if (button->click_only) {
-        // Click-only button: just execute the toggle command
-        execute_command(button->toggle_command);
+        // Click-only button: repeated clicks while it runs are served by that run
+        if (button->pid) return;
+        run_button_intent(widget, page, button_index);
     } else {
-        // Toggle button: change state and execute appropriate command
+        // Toggle button: change state optimistically, rolled back if the command fails
         button->is_active = !button->is_active;
-        execute_command(button->is_active ? button->toggle_command : button->untoggle_command);
+        if (!button->pid) {
+            run_button_intent(widget, page, button_index);
+            return;
+        }
+        
+        // Busy: a newer intent supersedes the command in flight, while flipping
+        // back to its target just lets it finish
+        damage_page(widget, page, DAMAGE_BUTTON(button_index));
+        if (button->is_active != button->target_active && !button->cancelled)
+            cancel_button_command(button);
     }
-    
-    widget->needs_redraw = 1;
 }
 
 void change_page(Widget *widget, int direction) {
@@ -502,52 +5003,134 @@ void change_page(Widget *widget, int direction) {
         new_page = 0;
     }
     
-    if (new_page != widget->current_page) {
-        for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
-            widget->buttons[widget->current_page][i].is_pressed = 0;
+    set_page(widget, new_page);
+}
+
+void set_page(Widget *widget, int page) {
+    if (page < 0 || page >= widget->total_pages || page == widget->current_page) return;
+    
+    for (int i = 0; i < widget->pages[widget->current_page].button_count; i++) {
+        if (widget->pages[widget->current_page].buttons[i].is_pressed) {
+            widget->pages[widget->current_page].buttons[i].is_pressed = 0;
+            damage_page(widget, widget->current_page, DAMAGE_BUTTON(i));
         }
-        
-        widget->current_page = new_page;
-        widget->needs_redraw = 1;
     }
+    
+    widget->current_page = page;
+    widget->needs_redraw = 1;
+    load_page(widget, page);
+    if (widget->timer_count) update_countdowns(widget);
 }
 
 void cleanup_widget(Widget *widget) {
-    XftColorFree(widget->display, widget->visual, widget->colormap, &widget->xft_text_color);
-    XftColorFree(widget->display, widget->visual, widget->colormap, &widget->xft_active_text_color);
-    XftColorFree(widget->display, widget->visual, widget->colormap, &widget->xft_icon_color);
-    XftColorFree(widget->display, widget->visual, widget->colormap, &widget->xft_active_icon_color);
-    XftColorFree(widget->display, widget->visual, widget->colormap, &widget->xft_page_color);
-    XftColorFree(widget->display, widget->visual, widget->colormap, &widget->xft_page_active_color);
-    XftFontClose(widget->display, widget->icon_font);
-    XftFontClose(widget->display, widget->text_font);
-    XftFontClose(widget->display, widget->page_font);
-    XftDrawDestroy(widget->xft_draw);
+    release_colors(widget);
+    close_fonts(widget);
+    teardown_page_cache(widget);
     
-    unsigned long pixels[] = {
-        widget->bg_color.pixel, widget->text_color.pixel, widget->window_border_color.pixel, widget->border_color.pixel,
-        widget->button_bg_color.pixel, widget->active_bg_color.pixel, 
-        widget->active_text_color.pixel, widget->active_border_color.pixel,
-        widget->pressed_bg_color.pixel, widget->page_color.pixel, widget->page_active_color.pixel
-    };
-    XFreeColors(widget->display, widget->colormap, pixels, 11, 0);
+    teardown_probes(widget);
+    teardown_watches(widget);
+    for (int i = 0; i < widget->live_count; i++) {
+        stop_live_label(widget, i);
+    }
+    free(widget->live_labels);
+    free(widget->timer_notify);
+    free(widget->timers);
+    free(widget->work_notify);
+    
+    // A session still running is credited up to now
+    credit_work_session(&widget->work);
+    close_work_ledger(&widget->work);
+    stop_filter(widget);
+    free_search_index(widget);
+    resize_pages(widget, 0);
+    free(widget->pages);
+    
+    close(widget->timer_fd);
+    close(widget->signal_fd);
+    close(widget->epoll_fd);
+    free(widget->loop_sources);
+    for (int i = 0; i < widget->render_list.rect_batch_capacity; i++)
+        free(widget->render_list.rect_batches[i].rects);
+    for (int i = 0; i < widget->render_list.glyph_batch_capacity; i++)
+        free(widget->render_list.glyph_batches[i].specs);
+    free(widget->render_list.rect_batches);
+    free(widget->render_list.glyph_batches);
+    if (widget->zygote_fd >= 0)
+        close(widget->zygote_fd);
+    if (widget->probe_timer_fd >= 0)
+        close(widget->probe_timer_fd);
+    if (widget->live_timer_fd >= 0)
+        close(widget->live_timer_fd);
+    if (widget->countdown_timer_fd >= 0)
+        close(widget->countdown_timer_fd);
+    if (widget->work_timer_fd >= 0)
+        close(widget->work_timer_fd);
+    if (widget->config_watch_fd >= 0)
+        close(widget->config_watch_fd);
+    if (widget->control_fd >= 0) {
+        struct sockaddr_un address;
+        close(widget->control_fd);
+        if (control_socket_path(&address) == 0) unlink(address.sun_path);
+    }
+    free_config(widget->config, widget->config_size, widget->config_mapped);
     
     XFreeGC(widget->display, widget->gc);
+    if (widget->hover_window != None)
+        XDestroyWindow(widget->display, widget->hover_window);
     XDestroyWindow(widget->display, widget->window);
     XCloseDisplay(widget->display);
 }
 
-int check_compositor(Display *display) {
+void request_compositor_check(Widget *widget) {
+#ifdef USE_XCB
+    // Both atoms are requested up front and resolved after the colours
+    char prop_name[32];
+    snprintf(prop_name, sizeof(prop_name), "_NET_WM_CM_S%d", DefaultScreen(widget->display));
+    widget->cm_atom_cookie = xcb_intern_atom(widget->xcb, 0, strlen(prop_name), prop_name);
+    widget->opacity_atom_cookie = xcb_intern_atom(widget->xcb, 0, strlen("_NET_WM_WINDOW_OPACITY"),
+                                                  "_NET_WM_WINDOW_OPACITY");
+#else
+    (void)widget;
+#endif
+}
+
+int check_compositor(Widget *widget) {
+#ifdef USE_XCB
+    xcb_intern_atom_reply_t *atom_reply = xcb_intern_atom_reply(widget->xcb, widget->cm_atom_cookie, NULL);
+    if (!atom_reply) return 0;
+    
+    widget->cm_owner_cookie = xcb_get_selection_owner(widget->xcb, atom_reply->atom);
+    free(atom_reply);
+    
+    xcb_get_selection_owner_reply_t *owner_reply =
+        xcb_get_selection_owner_reply(widget->xcb, widget->cm_owner_cookie, NULL);
+    if (!owner_reply) return 0;
+    
+    int has_owner = owner_reply->owner != XCB_NONE;
+    free(owner_reply);
+    return has_owner;
+#else
+    Display *display = widget->display;
     char prop_name[32];
     snprintf(prop_name, sizeof(prop_name), "_NET_WM_CM_S%d", DefaultScreen(display));
     Atom atom = XInternAtom(display, prop_name, False);
     return XGetSelectionOwner(display, atom) != None;
+#endif
 }
 
 void set_window_opacity(Widget *widget, double opacity) {
     if (!widget->has_compositor) return;
     
+#ifdef USE_XCB
+    Atom atom = None;
+    xcb_intern_atom_reply_t *reply = xcb_intern_atom_reply(widget->xcb, widget->opacity_atom_cookie, NULL);
+    if (reply) {
+        atom = reply->atom;
+        free(reply);
+    }
+#else
     Atom atom = XInternAtom(widget->display, "_NET_WM_WINDOW_OPACITY", False);
+#endif
     if (atom != None) {
         unsigned long opacity_value = (unsigned long)(opacity * 0xFFFFFFFF);
         XChangeProperty(widget->display, widget->window, atom, XA_CARDINAL, 32,
@@ -555,224 +5138,522 @@ void set_window_opacity(Widget *widget, double opacity) {
     }
 }
 
-int main() {
-    Widget widget;
-    XEvent event;
-    int has_focus = 0;
-    
-    init_widget(&widget);
-    
-    while (1) {
-        // Process all pending X events first
-        while (XPending(widget.display)) {
-            XNextEvent(widget.display, &event);
+void handle_event(Widget *widget, XEvent *event) {
+    switch (event->type) {
+        case Expose:
+            // Answered from the back buffer; re-rendering is only needed when contents change
+            present_widget(widget, event->xexpose.x, event->xexpose.y,
+                           event->xexpose.width, event->xexpose.height);
+            break;
+        
+        case EnterNotify:
+            if (event->xcrossing.window == widget->hover_window) {
+                widget->pointer_in_hover = 1;
+                break;
+            }
+            widget->pointer_in_widget = 1;
+            widget->has_focus = 1;
+            // Only grab focus when mouse actually enters
+            XSetInputFocus(widget->display, widget->window, RevertToPointerRoot, CurrentTime);
+            break;
+        
+        case LeaveNotify:
+            // Recompute both flags from root coordinates, since the matching
+            // EnterNotify for the other window may not have been read yet
+            widget->pointer_in_hover = point_in_hover_zone(widget, event->xcrossing.x_root, event->xcrossing.y_root);
+            widget->pointer_in_widget = point_over_widget(widget, event->xcrossing.x_root, event->xcrossing.y_root);
+            if (event->xcrossing.window == widget->hover_window) break;
             
-            switch (event.type) {
-                case Expose:
-                    widget.needs_redraw = 1;
-                    break;
-                
-                case EnterNotify:
-                    has_focus = 1;
-                    // Only grab focus when mouse actually enters
-                    XSetInputFocus(widget.display, widget.window, RevertToPointerRoot, CurrentTime);
-                    widget.needs_redraw = 1;
-                    break;
+            widget->has_focus = 0;
+            // Explicitly release focus back to the root window or previous window
+            XSetInputFocus(widget->display, PointerRoot, RevertToPointerRoot, CurrentTime);
+            break;
+        
+        case FocusIn:
+            widget->has_focus = 1;
+            break;
+        
+        case FocusOut:
+            widget->has_focus = 0;
+            break;
+        
+        case MotionNotify:
+            // More precise focus handling based on exact mouse position
+            if (event->xmotion.x >= 0 && event->xmotion.x < widget->width &&
+                event->xmotion.y >= 0 && event->xmotion.y < widget->height) {
+                if (!widget->has_focus) {
+                    widget->has_focus = 1;
+                    XSetInputFocus(widget->display, widget->window, RevertToPointerRoot, CurrentTime);
+                }
+            } else {
+                if (widget->has_focus) {
+                    widget->has_focus = 0;
+                    XSetInputFocus(widget->display, PointerRoot, RevertToPointerRoot, CurrentTime);
+                }
+            }
+            break;
+            
+        case ButtonPress:
+            // Only grab focus if we're actually clicking on the widget
+            if (event->xbutton.x >= 0 && event->xbutton.x < widget->width &&
+                event->xbutton.y >= 0 && event->xbutton.y < widget->height) {
+                widget->has_focus = 1;
+                XSetInputFocus(widget->display, widget->window, RevertToPointerRoot, CurrentTime);
+            }
+            
+            if (event->xbutton.button == Button1) {
+                int button_index = get_button_at_position(widget, 
+                                                          event->xbutton.x, 
+                                                          event->xbutton.y);
+                if (button_index >= 0) {
+                    int page = shown_page(widget);
+                    resolve_slot(widget, &page, &button_index);
+                    widget->pages[page].buttons[button_index].is_pressed = 1;
+                    damage_page(widget, page, DAMAGE_BUTTON(button_index));
+                }
+            }
+            // Scroll wheel support
+            else if (event->xbutton.button == Button4) { // Scroll up
+                change_page(widget, -1);
+            }
+            else if (event->xbutton.button == Button5) { // Scroll down
+                change_page(widget, 1);
+            }
+            break;
+            
+        case ButtonRelease:
+            if (event->xbutton.button == Button1) {
+                int button_index = get_button_at_position(widget, 
+                                                          event->xbutton.x, 
+                                                          event->xbutton.y);
+                int shown = shown_page(widget);
+                for (int i = 0; i < page_slots(widget, shown)->button_count; i++) {
+                    int page = shown, index = i;
+                    resolve_slot(widget, &page, &index);
+                    if (widget->pages[page].buttons[index].is_pressed) {
+                        widget->pages[page].buttons[index].is_pressed = 0;
+                        damage_page(widget, page, DAMAGE_BUTTON(index));
+                    }
+                }
                 
-                case LeaveNotify:
-                    has_focus = 0;
-                    // Explicitly release focus back to the root window or previous window
-                    XSetInputFocus(widget.display, PointerRoot, RevertToPointerRoot, CurrentTime);
-                    widget.needs_redraw = 1;
+                if (button_index >= 0) {
+                    int page = shown;
+                    resolve_slot(widget, &page, &button_index);
+                    toggle_button(widget, page, button_index);
+                }
+            }
+            break;
+        
+        case KeyPress: {
+            if (!widget->has_focus) break;
+            
+            // While filtering, keys type into the query
+            if (widget->filter.active) {
+                handle_filter_key(widget, &event->xkey);
+                break;
+            }
+            
+            KeySym keysym = XLookupKeysym(&event->xkey, 0);
+            
+            if (SCROLL_DIRECTION) {
+                switch (keysym) {
+                    case XK_Left:
+                    case XK_a:
+                    case XK_h:
+                        change_page(widget, -1);
+                        break;
+                    case XK_Right:
+                    case XK_d:
+                    case XK_l:
+                        change_page(widget, 1);
+                        break;
+                }
+            } else {
+                switch (keysym) {
+                    case XK_Up:
+                    case XK_w:
+                    case XK_k:
+                        change_page(widget, -1);
+                        break;
+                    case XK_Down:
+                    case XK_s:
+                    case XK_j:
+                        change_page(widget, 1);
+                        break;
+                }
+            }
+            
+            switch (keysym) {
+                case XK_Page_Up:
+                    change_page(widget, -1);
                     break;
-                
-                case FocusIn:
-                    has_focus = 1;
+                case XK_Page_Down:
+                    change_page(widget, 1);
                     break;
-                
-                case FocusOut:
-                    has_focus = 0;
+                case XK_Home:
+                    set_page(widget, 0);
                     break;
-                
-                case MotionNotify:
-                    // More precise focus handling based on exact mouse position
-                    if (event.xmotion.x >= 0 && event.xmotion.x < WIDGET_WIDTH &&
-                        event.xmotion.y >= 0 && event.xmotion.y < WIDGET_HEIGHT) {
-                        if (!has_focus) {
-                            has_focus = 1;
-                            XSetInputFocus(widget.display, widget.window, RevertToPointerRoot, CurrentTime);
-                        }
-                    } else {
-                        if (has_focus) {
-                            has_focus = 0;
-                            XSetInputFocus(widget.display, PointerRoot, RevertToPointerRoot, CurrentTime);
-                        }
-                    }
+                case XK_End:
+                    set_page(widget, widget->total_pages - 1);
                     break;
-                    
-                case ButtonPress:
-                    // Only grab focus if we're actually clicking on the widget
-                    if (event.xbutton.x >= 0 && event.xbutton.x < WIDGET_WIDTH &&
-                        event.xbutton.y >= 0 && event.xbutton.y < WIDGET_HEIGHT) {
-                        has_focus = 1;
-                        XSetInputFocus(widget.display, widget.window, RevertToPointerRoot, CurrentTime);
-                    }
-                    
-                    if (event.xbutton.button == Button1) {
-                        int button_index = get_button_at_position(&widget, 
-                                                                  event.xbutton.x, 
-                                                                  event.xbutton.y);
-                        if (button_index >= 0) {
-                            widget.buttons[widget.current_page][button_index].is_pressed = 1;
-                            widget.needs_redraw = 1;
-                        }
-                    }
-                    // Scroll wheel support
-                    else if (event.xbutton.button == Button4) { // Scroll up
-                        change_page(&widget, -1);
-                    }
-                    else if (event.xbutton.button == Button5) { // Scroll down
-                        change_page(&widget, 1);
+                case XK_Escape:
+                    if (widget->is_visible) {
+                        start_close_animation(widget);
                     }
                     break;
-                    
-                case ButtonRelease:
-                    if (event.xbutton.button == Button1) {
-                        int button_index = get_button_at_position(&widget, 
-                                                                  event.xbutton.x, 
-                                                                  event.xbutton.y);
-                        for (int i = 0; i < BUTTONS_PER_PAGE; i++) {
-                            widget.buttons[widget.current_page][i].is_pressed = 0;
-                        }
-                        
-                        if (button_index >= 0) {
-                            toggle_button(&widget, button_index);
-                        }
-                        widget.needs_redraw = 1;
-                    }
+                case XK_slash:
+                    start_filter(widget);
                     break;
-                
-                case KeyPress: {
-                    if (!has_focus) break;
-                    
-                    KeySym keysym = XLookupKeysym(&event.xkey, 0);
-                    
-                    if (SCROLL_DIRECTION) {
-                        switch (keysym) {
-                            case XK_Left:
-                            case XK_a:
-                            case XK_h:
-                                change_page(&widget, -1);
-                                break;
-                            case XK_Right:
-                            case XK_d:
-                            case XK_l:
-                                change_page(&widget, 1);
-                                break;
-                        }
-                    } else {
-                        switch (keysym) {
-                            case XK_Up:
-                            case XK_w:
-                            case XK_k:
-                                change_page(&widget, -1);
-                                break;
-                            case XK_Down:
-                            case XK_s:
-                            case XK_j:
-                                change_page(&widget, 1);
-                                break;
-                        }
-                    }
-                    
-                    switch (keysym) {
-                        case XK_Page_Up:
-                            change_page(&widget, -1);
-                            break;
-                        case XK_Page_Down:
-                            change_page(&widget, 1);
-                            break;
-                        case XK_Home:
-                            if (widget.current_page != 0) {
-                                widget.current_page = 0;
-                                widget.needs_redraw = 1;
-                            }
-                            break;
-                        case XK_End:
-                            if (widget.current_page != widget.total_pages - 1) {
-                                widget.current_page = widget.total_pages - 1;
-                                widget.needs_redraw = 1;
-                            }
-                            break;
-                        case XK_Escape:
-                            if (widget.is_visible) {
-                                start_close_animation(&widget);
-                            }
-                            break;
-                        case XK_1:
-                        case XK_2:
-                        case XK_3:
-                        case XK_4:
-                        case XK_5:
-                        case XK_6:
-                        case XK_7:
-                        case XK_8:
-                        case XK_9: {
-                            int page_num = keysym - XK_1;
-                            if (page_num < widget.total_pages && page_num != widget.current_page) {
-                                widget.current_page = page_num;
-                                widget.needs_redraw = 1;
-                            }
-                            break;
-                        }
-                    }
+                case XK_1:
+                case XK_2:
+                case XK_3:
+                case XK_4:
+                case XK_5:
+                case XK_6:
+                case XK_7:
+                case XK_8:
+                case XK_9: {
+                    set_page(widget, keysym - XK_1);
                     break;
                 }
-                    
-                case ConfigureNotify:
-                    if (widget.is_visible && !widget.is_closing) {
-                        XMoveWindow(widget.display, widget.window, widget.current_x,
-                                   (widget.screen_height - WIDGET_HEIGHT) / 2);
-                    }
-                    break;
             }
+            break;
         }
+            
+        case GenericEvent:
+            if (event->xcookie.extension == widget->present_opcode &&
+                XGetEventData(widget->display, &event->xcookie)) {
+                handle_present_event(widget, &event->xcookie);
+                XFreeEventData(widget->display, &event->xcookie);
+            }
+            break;
+            
+        case MapNotify:
+            if (event->xmap.event == widget->root_window)
+                keep_hover_window_on_top(widget, event->xmap.window);
+            break;
         
-        // Handle animation
-        if (widget.is_animating) {
-            animate_widget(&widget);
-            if (widget.is_visible || widget.is_animating) {
-                draw_widget(&widget);
+        case CirculateNotify:
+            if (event->xcirculate.event == widget->root_window)
+                keep_hover_window_on_top(widget, event->xcirculate.window);
+            break;
+            
+        case ConfigureNotify:
+            if (event->xconfigure.event == widget->root_window) {
+                keep_hover_window_on_top(widget, event->xconfigure.window);
+                break;
             }
-            usleep(ANIMATION_SLEEP_MS * 1000); // 16ms for ~60fps animation
-            continue;
+            if (widget->is_visible && !widget->is_closing) {
+                XMoveWindow(widget->display, widget->window, widget->current_x,
+                           (widget->screen_height - widget->height) / 2);
+            }
+            break;
+    }
+}
+
+void process_x_events(Widget *widget) {
+    XEvent event;
+    
+    while (XPending(widget->display)) {
+        XNextEvent(widget->display, &event);
+        handle_event(widget, &event);
+    }
+}
+
+int loop_add_fd(Widget *widget, int fd, uint32_t events, LoopHandler handler, void *data) {
+    int slot = 0;
+    while (slot < widget->loop_source_count && widget->loop_sources[slot].fd >= 0) slot++;
+    
+    if (slot == widget->loop_source_count) {
+        if (widget->loop_source_count == widget->loop_source_capacity) {
+            widget->loop_source_capacity = widget->loop_source_capacity ? widget->loop_source_capacity * 2 : 16;
+            widget->loop_sources = realloc(widget->loop_sources, widget->loop_source_capacity * sizeof(LoopSource));
+            if (!widget->loop_sources) exit(1);
+        }
+        widget->loop_sources[slot].fd = -1;
+        widget->loop_sources[slot].generation = 0;
+        widget->loop_source_count++;
+    }
+    
+    LoopSource *source = &widget->loop_sources[slot];
+    struct epoll_event ev = { .events = events, .data.u64 = (uint64_t)source->generation << 32 | (uint32_t)slot };
+    if (epoll_ctl(widget->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        fprintf(stderr, "swgt: cannot watch fd %d: %s\n", fd, strerror(errno));
+        return -1;
+    }
+    
+    source->fd = fd;
+    source->handler = handler;
+    source->data = data;
+    return 0;
+}
+
+void loop_remove_fd(Widget *widget, int fd) {
+    for (int i = 0; i < widget->loop_source_count; i++) {
+        if (widget->loop_sources[i].fd == fd) {
+            epoll_ctl(widget->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+            widget->loop_sources[i].fd = -1;
+            widget->loop_sources[i].generation++;
+            widget->loop_sources[i].handler = NULL;
+            widget->loop_sources[i].data = NULL;
+            return;
+        }
+    }
+}
+
+void handle_x_connection(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)fd; (void)events; (void)data;
+    process_x_events(widget);
+}
+
+void handle_frame_timer(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    uint64_t expirations;
+    
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+    
+    if (widget->is_animating) {
+        // Either the pacing tick or the watchdog for a vblank event that never came;
+        // a stalled notify must not block the next one
+        widget->present_notify_pending = 0;
+        run_frame(widget);
+    } else if (widget->hover_window == None) {
+        poll_pointer(widget);
+    }
+}
+
+void handle_signals(Widget *widget, int fd, uint32_t events, void *data) {
+    (void)events; (void)data;
+    struct signalfd_siginfo info;
+    
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        switch (info.ssi_signo) {
+            case SIGCHLD:
+                reap_children(widget);
+                break;
+            case SIGTERM:
+            case SIGINT:
+            case SIGHUP:
+                widget->running = 0;
+                break;
         }
+    }
+}
+
+void arm_frame_timer(Widget *widget, int delay_ms, int interval_ms) {
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = delay_ms / 1000;
+    spec.it_value.tv_nsec = (long)(delay_ms % 1000) * 1000000L;
+    spec.it_interval.tv_sec = interval_ms / 1000;
+    spec.it_interval.tv_nsec = (long)(interval_ms % 1000) * 1000000L;
+    timerfd_settime(widget->timer_fd, 0, &spec, NULL);
+    
+    // One-shot frame timers are never reused, so mark them distinct from any interval
+    widget->timer_interval_ms = delay_ms && !interval_ms ? -1 : interval_ms;
+}
+
+void schedule_frame(Widget *widget) {
+    if (widget->frame_pending) return;
+    widget->frame_pending = 1;
+    
+    if (!widget->present_opcode) {
+        arm_frame_timer(widget, ANIMATION_SLEEP_MS, 0);
+        return;
+    }
+    
+    // Paced by vblank; at most one notify is outstanding so frames never queue up.
+    // The timer only fires if the server stops answering, e.g. while off every CRTC
+    if (!widget->present_notify_pending) {
+        request_present_notify(widget);
+    }
+    arm_frame_timer(widget, ANIMATION_SLEEP_MS * 2, 0);
+}
+
+void run_frame(Widget *widget) {
+    widget->frame_pending = 0;
+    if (!widget->is_animating) return;
+    
+    animate_widget(widget);
+    draw_widget(widget);
+    
+    if (widget->is_animating) {
+        schedule_frame(widget);
+    }
+}
+
+void update_frame_timer(Widget *widget) {
+    // Frames schedule themselves while sliding
+    if (widget->is_animating) {
+        schedule_frame(widget);
+        return;
+    }
+    
+    // Pointer polls only in fallback mode, otherwise idle
+    int interval_ms = widget->hover_window == None ? IDLE_SLEEP_MS : 0;
+    if (interval_ms == widget->timer_interval_ms) return;
+    arm_frame_timer(widget, interval_ms, interval_ms);
+}
+
+void block_loop_signals(sigset_t *mask) {
+    sigemptyset(mask);
+    sigaddset(mask, SIGCHLD);
+    sigaddset(mask, SIGTERM);
+    sigaddset(mask, SIGINT);
+    sigaddset(mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, mask, NULL);
+}
+
+void setup_event_loop(Widget *widget) {
+    widget->loop_sources = NULL;
+    widget->loop_source_count = widget->loop_source_capacity = 0;
+    widget->running = 1;
+    widget->timer_interval_ms = 0;
+    
+    sigset_t mask;
+    block_loop_signals(&mask);
+    
+    widget->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    widget->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    widget->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (widget->epoll_fd < 0 || widget->signal_fd < 0 || widget->timer_fd < 0)
+        exit(1);
+    
+    if (loop_add_fd(widget, ConnectionNumber(widget->display), EPOLLIN, handle_x_connection, NULL) < 0 ||
+        loop_add_fd(widget, widget->signal_fd, EPOLLIN, handle_signals, NULL) < 0 ||
+        loop_add_fd(widget, widget->timer_fd, EPOLLIN, handle_frame_timer, NULL) < 0)
+        exit(1);
+    
+    // Probes are only refreshed while shown; without the timer they still run on each show
+    widget->probe_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (widget->probe_timer_fd >= 0 &&
+        loop_add_fd(widget, widget->probe_timer_fd, EPOLLIN, handle_probe_timer, NULL) < 0) {
+        close(widget->probe_timer_fd);
+        widget->probe_timer_fd = -1;
+    }
+    
+    if (widget->zygote_fd >= 0 && loop_add_fd(widget, widget->zygote_fd, EPOLLIN, handle_zygote, NULL) < 0) {
+        close(widget->zygote_fd);
+        widget->zygote_fd = -1;
+    }
+    
+    // Without the timer, countdowns only advance and end when the widget opens
+    widget->countdown_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (widget->countdown_timer_fd >= 0 &&
+        loop_add_fd(widget, widget->countdown_timer_fd, EPOLLIN, handle_countdown_timer, NULL) < 0) {
+        close(widget->countdown_timer_fd);
+        widget->countdown_timer_fd = -1;
+    }
+    
+    widget->work_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (widget->work_timer_fd >= 0 &&
+        loop_add_fd(widget, widget->work_timer_fd, EPOLLIN, handle_work_timer, NULL) < 0) {
+        close(widget->work_timer_fd);
+        widget->work_timer_fd = -1;
+    }
+    
+    // Without the timer, label updates wait for the next show
+    widget->live_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (widget->live_timer_fd >= 0 &&
+        loop_add_fd(widget, widget->live_timer_fd, EPOLLIN, handle_live_timer, NULL) < 0) {
+        close(widget->live_timer_fd);
+        widget->live_timer_fd = -1;
+    }
+    
+    if (widget->control_fd >= 0 &&
+        loop_add_fd(widget, widget->control_fd, EPOLLIN, handle_control_listen, NULL) < 0) {
+        close(widget->control_fd);
+        widget->control_fd = -1;
+    }
+}
+
+void run_event_loop(Widget *widget) {
+    struct epoll_event events[LOOP_EVENT_BATCH];
+    
+    while (widget->running) {
+        // Xlib may already hold events read during earlier requests
+        process_x_events(widget);
         
-        // Check mouse position only when not animating
-        int mouse_in_zone = check_mouse_in_hover_zone(&widget);
-        int mouse_over_widget = check_mouse_over_widget(&widget);
+        update_hover_state(widget);
+        update_frame_timer(widget);
         
-        if (mouse_in_zone && !widget.is_visible && !widget.is_closing) {
-            start_show_animation(&widget);
-        } else if (!mouse_in_zone && !mouse_over_widget && widget.is_visible && !widget.is_closing) {
-            widget.mouse_in_zone = 0;
-            // Release focus when hiding the widget
-            if (has_focus) {
-                has_focus = 0;
-                XSetInputFocus(widget.display, PointerRoot, RevertToPointerRoot, CurrentTime);
-            }
-            start_close_animation(&widget);
+        if ((widget->is_visible || widget->is_animating) && widget->needs_redraw) {
+            draw_widget(widget);
         }
+        // Idle time goes to rendering the pages a scroll would show next
+        if (widget->is_visible && !widget->is_animating) {
+            prerender_neighbours(widget);
+        }
+        XFlush(widget->display);
         
-        // Draw if needed
-        if (widget.is_visible && widget.needs_redraw) {
-            draw_widget(&widget);
+        int count = epoll_wait(widget->epoll_fd, events, LOOP_EVENT_BATCH, -1);
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
         
-        // Sleep longer when idle to achieve 0% CPU usage
-        usleep(IDLE_SLEEP_MS * 1000); // 50ms when idle
+        // Handlers may add and remove sources, so the slot is looked up each time
+        for (int i = 0; i < count; i++) {
+            uint32_t slot = (uint32_t)events[i].data.u64;
+            LoopSource *source = &widget->loop_sources[slot];
+            if (source->generation != (uint32_t)(events[i].data.u64 >> 32)) continue;
+            if (source->fd >= 0 && source->handler) {
+                source->handler(widget, source->fd, events[i].events, source->data);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    Widget widget;
+    
+    int dump_config = 0;
+    
+    // Commands for the running instance
+    if (argc > 1 && strcmp(argv[1], "msg") == 0) {
+        return control_client(argc - 2, argv + 2);
+    }
+    if (argc == 2 && strcmp(argv[1], "stats") == 0) {
+        return work_stats();
     }
     
+    widget.startup_report = 0;
+    widget.spawn_report = 0;
+    widget.frame_report = 0;
+    widget.config_path[0] = '\0';
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--startup-report") == 0) {
+            widget.startup_report = 1;
+        } else if (strcmp(argv[i], "--spawn-report") == 0) {
+            widget.spawn_report = 1;
+        } else if (strcmp(argv[i], "--frame-report") == 0) {
+            widget.frame_report = 1;
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            snprintf(widget.config_path, sizeof(widget.config_path), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--print-config") == 0) {
+            dump_config = 1;
+        } else {
+            fprintf(stderr, "usage: swgt [--config FILE] [--print-config] [--startup-report] [--spawn-report]\n"
+                            "            [--frame-report]\n"
+                            "       swgt msg COMMAND...\n"
+                            "       swgt stats\n");
+            return 1;
+        }
+    }
+    
+    // Prints the active configuration in file syntax, a starting point for editing
+    if (dump_config) {
+        resolve_config_path(&widget);
+        widget.config = load_config(&widget, &widget.config_size, &widget.config_mapped);
+        print_config(widget.config);
+        return 0;
+    }
+    
+    // A second launch shows the running instance instead of opening another window
+    if (claim_instance(&widget)) return 0;
+    
+    init_widget(&widget);
+    run_event_loop(&widget);
     cleanup_widget(&widget);
     return 0;
 }